@@ -0,0 +1,6 @@
+#pragma once
+
+// Please don't change the content of this header, it is auto generated by CMAKE
+
+// #define PROJECT_SOURCE_DIR "/root/repo/"
+#define PROJECT_SOURCE_DIR "./"
@@ -1,6 +1,9 @@
 // internal
 #include "ai_system.hpp"
 
+#include <chrono>
+#include <algorithm>
+
 void AISystem::step(float elapsed_ms)
 {
 	// update player entity
@@ -8,68 +11,174 @@ void AISystem::step(float elapsed_ms)
 	if (!players.empty()) {
 		player = players.back();
 	}
+	schedule_agents(elapsed_ms);
+	if (MOVE_ENEMIES) {
+		update_flow_field();
+	}
+	// the per agent work, what the far slice is budgeted by
+	auto start = std::chrono::steady_clock::now();
 	if (MOVE_ENEMIES) {
-		move_enemies(elapsed_ms);
-		swarm_keep_distance(elapsed_ms);
-		swarm_block_interestpoint(elapsed_ms);
+		move_enemies();
+		swarm_keep_distance();
+		swarm_block_interestpoint();
 	};
 	enemy_shoot(elapsed_ms);
-	enemy_dash(elapsed_ms);
+	enemy_dash();
+	finish_agents(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
 }
 
-void AISystem::move_enemies(float elapsed_ms) {
-	Transform& playerTransform = registry.transforms.get(player);
+void AISystem::schedule_agents(float elapsed_ms) {
+	lod_counters = AILodCounters();
+	lod_tick++;
+	far_agents.clear();
+	vec2 camera_position = registry.camera.size() > 0 ? registry.camera.components[0].position : registry.transforms.get(player).position;
+
 	for (Entity entity : registry.enemies.entities) {
-		if (registry.motions.has(entity)) {
-			assert(registry.transforms.has(entity));
-			Transform& enemytransform = registry.transforms.get(entity);
-			Motion& enemymotion = registry.motions.get(entity);
-			if (registry.attachments.has(entity)) {
-				float elapsed_seconds = elapsed_ms / 1000.f;
-				move_articulated_part(elapsed_seconds, entity, enemymotion, enemytransform, playerTransform);
-				continue;
+		if (entity.index() >= agents.size()) {
+			agents.resize(std::max((size_t)entity.index() + 1, agents.size() * 2));
+		}
+		Agent& agent = agents[entity.index()];
+		if (agent.entity != entity) {
+			agent = Agent();
+			agent.entity = entity;
+		}
+		agent.elapsed_ms += elapsed_ms;
+
+		AI_LOD_BAND band = AI_LOD_BAND::NEAR;
+		if (registry.transforms.has(entity)) {
+			vec2 offset = registry.transforms.get(entity).position - camera_position;
+			float dist2 = dot(offset, offset);
+			if (dist2 > AI_LOD_MID_RADIUS * AI_LOD_MID_RADIUS) band = AI_LOD_BAND::FAR;
+			else if (dist2 > AI_LOD_NEAR_RADIUS * AI_LOD_NEAR_RADIUS) band = AI_LOD_BAND::MID;
+		}
+		lod_counters.agents[(int)band]++;
+
+		if (band == AI_LOD_BAND::NEAR) {
+			agent.scheduled = true;
+		} else if (band == AI_LOD_BAND::MID) {
+			// spread over the ticks by entity, so every tick runs about the same share of them
+			agent.scheduled = (lod_tick + entity.index()) % AI_LOD_MID_INTERVAL == 0;
+		} else {
+			agent.scheduled = false;
+			far_agents.push_back(entity.index());
+		}
+		if (agent.scheduled) {
+			lod_counters.ran[(int)band]++;
+		}
+	}
+
+	// The far agents that waited the longest run first, as many as the budget fits going by the measured cost
+	// per agent. At least one runs every tick so they all get their turn
+	size_t far_slice = agent_cost_us > 0.f ? (size_t)(AI_LOD_FAR_BUDGET_US / agent_cost_us) : far_agents.size();
+	far_slice = std::min(std::max(far_slice, (size_t)1), far_agents.size());
+	std::nth_element(far_agents.begin(), far_agents.begin() + far_slice, far_agents.end(), [this](unsigned int a, unsigned int b) {
+		return agents[a].elapsed_ms > agents[b].elapsed_ms;
+	});
+	for (size_t k = 0; k < far_slice; k++) {
+		agents[far_agents[k]].scheduled = true;
+	}
+	lod_counters.ran[(int)AI_LOD_BAND::FAR] = (unsigned int)far_slice;
+}
+
+const AISystem::Agent* AISystem::scheduled_agent(Entity entity) const {
+	if (entity.index() >= agents.size()) return nullptr;
+	const Agent& agent = agents[entity.index()];
+	return agent.entity == entity && agent.scheduled ? &agent : nullptr;
+}
+
+void AISystem::finish_agents(float run_us) {
+	unsigned int ran = 0;
+	for (Entity entity : registry.enemies.entities) {
+		// enemies created during the tick are scheduled from the next one
+		if (entity.index() >= agents.size() || agents[entity.index()].entity != entity) continue;
+		Agent& agent = agents[entity.index()];
+		bool moves = registry.motions.has(entity);
+		if (agent.scheduled) {
+			// nothing else adds forces to the enemies before the AI in a tick
+			if (moves) agent.force = registry.motions.get(entity).force;
+			agent.elapsed_ms = 0.f;
+			ran++;
+		} else if (moves && registry.motions.get(entity).allow_accel) {
+			registry.motions.get(entity).force += agent.force;
+		}
+	}
+	if (ran > 0) {
+		float cost_us = run_us / ran;
+		agent_cost_us = agent_cost_us > 0.f ? agent_cost_us * 0.9f + cost_us * 0.1f : cost_us;
+	}
+}
+
+void AISystem::move_enemies() {
+	TransformRef playerTransform = registry.transforms.get(player);
+	registry.view<Enemy, Motion, Transform>().each([&](Entity entity, Enemy& enemyAttribute, MotionRef enemymotion, TransformRef enemytransform) {
+		const Agent* agent = scheduled_agent(entity);
+		if (!agent) return;
+		if (registry.attachments.has(entity)) {
+			float elapsed_seconds = agent->elapsed_ms / 1000.f;
+			move_articulated_part(elapsed_seconds, entity, enemymotion, enemytransform, playerTransform);
+			return;
+		}
+		if (enemymotion.allow_accel == false) {
+			enemymotion.allow_accel = true;
+			return;
+		}
+
+		// Boss chases player forever after it's activated
+		vec2 target_point = playerTransform.position;
+		if (enemyAttribute.type == ENEMY_ID::BOSS) {
+			if (!registry.bosses.get(entity).activated) {
+				enemymotion.max_velocity = 0.f;
+				//target_point = enemytransform.position;
+				//enemytransform.angle = atan2f(target_point.y - enemytransform.position.y, target_point.x - enemytransform.position.x) ;
+				//for (auto& region : registry.regions.components) {
+				//	if (region.goal == REGION_GOAL_ID::CURE) {
+				//		target_point = region.interest_point;
+				//	}
+				//}
 			}
-			if (enemymotion.allow_accel == false) {
-				enemymotion.allow_accel = true;
-				continue;
+		} else if (enemyAttribute.type == ENEMY_ID::FRIENDBOSS) {
+			if (!registry.bosses.get(entity).activated) {
+				enemymotion.max_velocity = 0.f;
+				//target_point = enemytransform.position;
+				//enemytransform.angle = atan2f(target_point.y - enemytransform.position.y, target_point.x - enemytransform.position.x) + enemytransform.angle_offset;
+				//for (auto& region : registry.regions.components) {
+				//	if (region.goal == REGION_GOAL_ID::CANCER_CELL) {
+				//		target_point = region.interest_point;
+				//	}
+				//}
 			}
-
-			// Boss chases player forever after it's activated
-			Enemy& enemyAttribute = registry.enemies.get(entity);
-			vec2 target_point = playerTransform.position;
-			if (enemyAttribute.type == ENEMY_ID::BOSS) {
-				if (!registry.bosses.get(entity).activated) {
-					enemymotion.max_velocity = 0.f;
-					//target_point = enemytransform.position;
-					//enemytransform.angle = atan2f(target_point.y - enemytransform.position.y, target_point.x - enemytransform.position.x) ;
-					//for (auto& region : registry.regions.components) {
-					//	if (region.goal == REGION_GOAL_ID::CURE) {
-					//		target_point = region.interest_point;
-					//	}
-					//}
-				}
-			} else if (enemyAttribute.type == ENEMY_ID::FRIENDBOSS) {
-				if (!registry.bosses.get(entity).activated) {
-					enemymotion.max_velocity = 0.f;
-					//target_point = enemytransform.position;
-					//enemytransform.angle = atan2f(target_point.y - enemytransform.position.y, target_point.x - enemytransform.position.x) + enemytransform.angle_offset;
-					//for (auto& region : registry.regions.components) {
-					//	if (region.goal == REGION_GOAL_ID::CANCER_CELL) {
-					//		target_point = region.interest_point;
-					//	}
-					//}
-				}
-				Dash& enemyDash = registry.dashes.get(entity);
-				if (enemyDash.active_timer_ms > 0.f) {
-					target_point = enemytransform.position;	// Do not move
-				}
+			Dash& enemyDash = registry.dashes.get(entity);
+			if (enemyDash.active_timer_ms > 0.f) {
+				target_point = enemytransform.position;	// Do not move
 			}
-			enemymotion.force += normalize(vec2(target_point.x - enemytransform.position.x, target_point.y - enemytransform.position.y));
+		}
+		vec2 direction = normalize(vec2(target_point.x - enemytransform.position.x, target_point.y - enemytransform.position.y));
+		// Regular enemies go around the obstacles until they are close to the player
+		if (enemyAttribute.type != ENEMY_ID::BOSS && enemyAttribute.type != ENEMY_ID::FRIENDBOSS
+			&& flow_field.path_length(enemytransform.position) > FLOW_FIELD_DIRECT_RANGE) {
+			vec2 flow = flow_field.direction(enemytransform.position);
+			if (flow != vec2(0.f)) {
+				direction = flow;
+			}
+		}
+		enemymotion.force += direction;
+	});
+}
+
+void AISystem::update_flow_field() {
+	// The cysts only change when one is created or destroyed
+	if (registry.cysts.version() != flow_field_cyst_version) {
+		flow_field_cyst_version = registry.cysts.version();
+		flow_field.clear_obstacles();
+		for (Entity cyst : registry.cysts.entities) {
+			Transform transform = registry.transforms.get(cyst);
+			flow_field.block_circle(transform.position, max(transform.scale.x, transform.scale.y) / 2.f + FLOW_FIELD_CLEARANCE);
 		}
 	}
+	flow_field.update(registry.transforms.get(player).position);
 }
 
-void AISystem::move_articulated_part(float elapsed_seconds, Entity partEntity, Motion& partMotion, Transform& partTranform, Transform& playerTransform) {
+void AISystem::move_articulated_part(float elapsed_seconds, Entity partEntity, MotionRef partMotion, TransformRef partTranform, TransformRef playerTransform) {
 	assert(registry.attachments.has(partEntity));
 
 	vec2 dist = { playerTransform.position - partTranform.position };
@@ -93,43 +202,77 @@ void AISystem::move_articulated_part(float elapsed_seconds, Entity partEntity, M
 }
 
 
-void AISystem::swarm_keep_distance(float elapsed_ms) {
-	Transform& playerTransform = registry.transforms.get(player);
+void AISystem::build_swarm_grid() {
+	swarm_grid.clear();
+	swarm_entities.clear();
+	swarm_positions.clear();
 	for (Entity entity : registry.enemies.entities) {
+		if (!registry.transforms.has(entity)) continue;
+		vec2 position = registry.transforms.get(entity).position;
+		swarm_entities.push_back(entity);
+		swarm_positions.push_back(position);
+	}
+	if (swarm_positions.size() < SWARM_GRID_MIN_ENEMIES) return;
+	for (unsigned int i = 0; i < swarm_positions.size(); i++) {
+		swarm_grid.insert(i, swarm_positions[i], swarm_positions[i]);
+	}
+	swarm_grid.build();
+}
+
+int AISystem::nearest_swarm_neighbour(unsigned int item) const {
+	vec2 position = swarm_positions[item];
+	int nearest = -1;
+	float nearest_dist2 = INFINITY;
+	auto consider = [&](unsigned int other) {
+		if (other == item) return;
+		vec2 diff = swarm_positions[other] - position;
+		float dist2 = dot(diff, diff);
+		if (dist2 < nearest_dist2 || (dist2 == nearest_dist2 && (int)other < nearest)) {
+			nearest_dist2 = dist2;
+			nearest = (int)other;
+		}
+	};
+
+	// Search boxes of doubling size around the enemy. Every enemy outside the box is farther than its
+	// half width, so the search stops once the nearest one found is within it. Once the box has more
+	// cells than there are enemies, as with a lone enemy, checking all of them is cheaper
+	for (float reach = swarm_grid.get_cell_size(); ; reach *= 2.f) {
+		float cells = 2.f * reach / swarm_grid.get_cell_size() + 1.f;
+		if (swarm_positions.size() < SWARM_GRID_MIN_ENEMIES || cells * cells > swarm_positions.size()) {
+			for (unsigned int other = 0; other < swarm_positions.size(); other++)
+				consider(other);
+			return nearest;
+		}
+		swarm_grid.query(position - reach, position + reach, consider);
+		if (nearest_dist2 <= reach * reach) {
+			return nearest;
+		}
+	}
+}
+
+void AISystem::swarm_keep_distance() {
+	build_swarm_grid();
+	for (unsigned int i = 0; i < swarm_entities.size(); i++) {
+		Entity entity = swarm_entities[i];
+		if (!scheduled_agent(entity)) continue;	// Still a neighbour of the others
 		if (registry.motions.has(entity)			// Ignore if can't move
 			&& !registry.bosses.has(entity)			// Ignore if is a boss
 			&& !registry.attachments.has(entity)) { // Ignore if is an attachment
-			Motion& enemymotion = registry.motions.get(entity);
+			MotionRef enemymotion = registry.motions.get(entity);
 			if (enemymotion.max_velocity == 0.f) continue;	// Ignore if can't move
 
-			assert(registry.transforms.has(entity));
-			Transform& enemytransform = registry.transforms.get(entity);
-
-			// Find the closest enemy
-			float minDist = INFINITY;
-			Entity closestEnemy;
-			for (Entity otherEnemy : registry.enemies.entities) {
-				if (entity != otherEnemy && registry.transforms.has(otherEnemy)) {
-					vec2 otherEnemyPos = registry.transforms.get(otherEnemy).position;
-					float dist = length(otherEnemyPos - enemytransform.position);
-					if (dist < minDist) {
-						minDist = dist;
-						closestEnemy = otherEnemy;
-					}
-				}
-			}
 			// Add a small repelling force from the closest enemy
-			if (registry.transforms.has(closestEnemy)) {
-				vec2 closestEnemyPos = registry.transforms.get(closestEnemy).position;
-				enemymotion.force += normalize(enemytransform.position - closestEnemyPos) / 2.f;
+			int closest = nearest_swarm_neighbour(i);
+			if (closest >= 0) {
+				enemymotion.force += normalize(swarm_positions[i] - swarm_positions[closest]) / 2.f;
 			}
 		}
 	}
 }
 
 
-void AISystem::swarm_block_interestpoint(float elapsed_ms) {
-	Transform& playerTransform = registry.transforms.get(player);
+void AISystem::swarm_block_interestpoint() {
+	TransformRef playerTransform = registry.transforms.get(player);
 	// Find closest interest point to the player
 	vec2 closest_interest_point;
 	float min_dist = INFINITY;
@@ -143,16 +286,17 @@ void AISystem::swarm_block_interestpoint(float elapsed_ms) {
 	for (uint i = 0; i < registry.enemies.size(); i++) {
 		Entity entity = registry.enemies.entities[i];
 		Enemy& enemyAttrib = registry.enemies.components[i];
+		if (!scheduled_agent(entity)) continue;
 		if (registry.motions.has(entity)						// Ignore if can't move
 			&& enemyAttrib.type != ENEMY_ID::FRIENDBOSSCLONE	// Ignore if is boss clone
 			&& enemyAttrib.type != ENEMY_ID::FRIENDBOSS			// Ignore if is boss
 			&& enemyAttrib.type != ENEMY_ID::BOSS				// Ignore if is boss
 			&& enemyAttrib.type != ENEMY_ID::BOSS_ARM) {		// Ignore if is boss arm
-			Motion& enemymotion = registry.motions.get(entity);
+			MotionRef enemymotion = registry.motions.get(entity);
 			if (enemymotion.max_velocity == 0.f) continue;	// Ignore if can't move
 			
 			assert(registry.transforms.has(entity));
-			Transform& enemytransform = registry.transforms.get(entity);
+			TransformRef enemytransform = registry.transforms.get(entity);
 			if (length(closest_interest_point - enemytransform.position) > SCREEN_RADIUS * 1.5f) continue;	// Ignore if too far
 
 			// Add a small attraction force towards the interest-point
@@ -163,9 +307,16 @@ void AISystem::swarm_block_interestpoint(float elapsed_ms) {
 
 void AISystem::enemy_shoot(float elapsed_ms) {
 	for (Entity entity : registry.guns.entities) {
+		// Enemy guns advance by the time since their enemy last ran
+		float gun_elapsed_ms = elapsed_ms;
+		if (registry.enemies.has(entity)) {
+			const Agent* agent = scheduled_agent(entity);
+			if (!agent) continue;
+			gun_elapsed_ms = agent->elapsed_ms;
+		}
 		Gun& enemyGun = registry.guns.get(entity);
 		vec2 playerposition = registry.transforms.get(player).position;
-		Transform& enemy_transform = registry.transforms.get(entity);
+		TransformRef enemy_transform = registry.transforms.get(entity);
 		vec2 distance = abs(playerposition - enemy_transform.position) - length(enemy_transform.scale / 2.f);	// As soon as the enemy is partially visible
 		if (registry.enemies.has(entity) && distance.x <= CONTENT_WIDTH_PX / 2 && distance.y <= CONTENT_HEIGHT_PX / 2) {
 			if (enemyGun.attack_timer <= 0) {
@@ -190,22 +341,24 @@ void AISystem::enemy_shoot(float elapsed_ms) {
 				enemyGun.attack_timer = enemyGun.attack_delay;
 			}
 		}
-		enemyGun.attack_timer = max(enemyGun.attack_timer - elapsed_ms, 0.f);
+		enemyGun.attack_timer = max(enemyGun.attack_timer - gun_elapsed_ms, 0.f);
 
 	}
 }
 
-void AISystem::enemy_dash(float elapsed_ms) {
+void AISystem::enemy_dash() {
 	vec2 playerposition = registry.transforms.get(player).position;
 	for (Entity entity : registry.dashes.entities) {
 		Transform enemyTransform = registry.transforms.get(entity);
 		if (registry.enemies.has(entity) && registry.bosses.has(entity) && registry.bosses.get(entity).activated) {
+			const Agent* agent = scheduled_agent(entity);
+			if (!agent) continue;
 			Enemy& enemyAttrib = registry.enemies.get(entity);
 			Dash& enemyDash = registry.dashes.get(entity);
 			
 			if (enemyDash.delay_timer_ms <= 0.f) {
 				// setup a new dash
-				Motion& enemymotion = registry.motions.get(entity);
+				MotionRef enemymotion = registry.motions.get(entity);
 				float currAngle = enemyTransform.angle - enemyTransform.angle_offset;
 				vec2 targetDiff = playerposition - enemyTransform.position;
 				float targetAngle = atan2f(targetDiff.y, targetDiff.x);
@@ -238,8 +391,8 @@ void AISystem::enemy_dash(float elapsed_ms) {
 				enemyDash.active_timer_ms = enemyDash.active_duration_ms;
 			}
 			else {
-				enemyDash.delay_timer_ms = max(enemyDash.delay_timer_ms - elapsed_ms, 0.f);
-				enemyDash.active_timer_ms = max(enemyDash.active_timer_ms - elapsed_ms, 0.f);
+				enemyDash.delay_timer_ms = max(enemyDash.delay_timer_ms - agent->elapsed_ms, 0.f);
+				enemyDash.active_timer_ms = max(enemyDash.active_timer_ms - agent->elapsed_ms, 0.f);
 			}
 		}
 	}
@@ -248,9 +401,6 @@ void AISystem::enemy_dash(float elapsed_ms) {
 
 
 void AISystem::enemy_special_attack(Entity enemy) {
-	Transform& enemytransform = registry.transforms.get(enemy);
-	Transform& playertransform = registry.transforms.get(player);
-
 	float decision = (static_cast<float>(rand()) / RAND_MAX); //This generates num between 0 and 1
 
 	if (decision <= 0.9f){ //90% of the time the boss will scattershot
@@ -262,22 +412,21 @@ void AISystem::enemy_special_attack(Entity enemy) {
 }
 
 void AISystem::spread_attack(Entity enemy) {
-	Transform& enemytransform = registry.transforms.get(enemy);
-
 	for (int i = 0; i < 6; i++) {
-		enemytransform.angle += 1;
+		// fetched every shot, creating the bullet may move the transforms
+		registry.transforms.get(enemy).angle += 1;
 		createBullet(enemy, { 13.f, 13.f }, { 1.f, 0.8f, 0.8f, 1.f });
 	}
 
 }
 
 void AISystem::clone_attack(Entity enemy, int clones) {
-	Transform& playertransform = registry.transforms.get(player);
-	
 	for (int i = 0; i < clones; i++) {
-		playertransform.angle += 1;
-		float xpos = playertransform.position.x + cos(playertransform.angle) * 800;
-		float ypos = playertransform.position.y + sin(playertransform.angle) * 800;
+		// fetched every clone, creating the clone may move the transforms
+		float angle = registry.transforms.get(player).angle += 1;
+		vec2 player_position = registry.transforms.get(player).position;
+		float xpos = player_position.x + cos(angle) * 800;
+		float ypos = player_position.y + sin(angle) * 800;
 		createBossClone({ xpos,ypos });
 
 	}
@@ -6,21 +6,98 @@
 #include "common.hpp"
 #include "world_init.hpp"
 #include "world_system.hpp"
+#include "spatial_grid.hpp"
+#include "flow_field.hpp"
+
+// Cell size of the grid of enemies used for swarm neighbour queries, a few enemies across
+const float SWARM_GRID_CELL_SIZE = 256.f;
+// Below this many enemies the neighbour queries check every enemy instead of building the grid
+const unsigned int SWARM_GRID_MIN_ENEMIES = 128;
+// Cell size of the flow field enemies follow to the player, around the size of a cyst
+const float FLOW_FIELD_CELL_SIZE = 128.f;
+// Room kept around the cysts in the flow field for the enemies passing them
+const float FLOW_FIELD_CLEARANCE = 32.f;
+// The flow field covers paths up to this long, enemies farther away head straight at the player
+const float FLOW_FIELD_RANGE = 4096.f;
+// Enemies with a shorter path than this to the player head straight at it as well
+const float FLOW_FIELD_DIRECT_RANGE = 2 * FLOW_FIELD_CELL_SIZE;
+
+// AI level of detail: enemies nearer to the camera than AI_LOD_NEAR_RADIUS run their AI every tick, the ones nearer
+// than AI_LOD_MID_RADIUS every AI_LOD_MID_INTERVAL ticks, and the farther ones take turns in slices of about
+// AI_LOD_FAR_BUDGET_US microseconds per tick
+const float AI_LOD_NEAR_RADIUS = SCREEN_RADIUS * 1.25f;
+const float AI_LOD_MID_RADIUS = SCREEN_RADIUS * 3.f;
+const unsigned int AI_LOD_MID_INTERVAL = 4;
+const float AI_LOD_FAR_BUDGET_US = 200.f;
+
+enum class AI_LOD_BAND {
+	NEAR = 0,
+	MID = NEAR + 1,
+	FAR = MID + 1,
+	AI_LOD_BAND_COUNT = FAR + 1
+};
+const int ai_lod_band_count = (int)AI_LOD_BAND::AI_LOD_BAND_COUNT;
+
+// Enemies in each band on the last tick, and how many of them ran their AI
+struct AILodCounters {
+	unsigned int agents[ai_lod_band_count] = {};
+	unsigned int ran[ai_lod_band_count] = {};
+};
 
 class AISystem
 {
 public:
 	void step(float elapsed_ms);
 
+	const AILodCounters& get_lod_counters() const { return lod_counters; }
+
 private:
 	Entity player; // Keep reference to player entity
-	void move_enemies(float elapsed_ms);
+	void move_enemies();
 	void enemy_shoot(float elapsed_ms);
-	void move_articulated_part(float elapsed_seconds, Entity partEntity, Motion& partMotion, Transform& partTranform, Transform& playerTransform);
-	void enemy_dash(float elapsed_ms);
+	void move_articulated_part(float elapsed_seconds, Entity partEntity, MotionRef partMotion, TransformRef partTranform, TransformRef playerTransform);
+	void enemy_dash();
 	void enemy_special_attack(Entity enemy);
 	void spread_attack(Entity enemy);
 	void clone_attack(Entity enemy, int clones);
-	void swarm_keep_distance(float elapsed_ms);
-	void swarm_block_interestpoint(float elapsed_ms);
+	void swarm_keep_distance();
+	void swarm_block_interestpoint();
+
+	// Positions of the enemies for the swarm neighbour queries, with a grid over them from SWARM_GRID_MIN_ENEMIES on.
+	// Rebuilt once per step
+	void build_swarm_grid();
+	// Index in swarm_entities of the enemy closest to enemy `item`, or -1 if it is the only one.
+	// Ties go to the enemy that comes first in registry.enemies
+	int nearest_swarm_neighbour(unsigned int item) const;
+
+	SpatialHashGrid swarm_grid{ SWARM_GRID_CELL_SIZE };
+	std::vector<Entity> swarm_entities;
+	std::vector<vec2> swarm_positions;
+
+	// Points the enemies around the cysts towards the player. Only the cysts stop enemies, the region walls only
+	// hold back the player, so they are not obstacles of the field
+	void update_flow_field();
+	FlowField flow_field{ FLOW_FIELD_CELL_SIZE, FLOW_FIELD_RANGE };
+	unsigned int flow_field_cyst_version = ~0u;
+
+	// Scheduling state of an enemy, indexed by Entity::index(). The stored entity tells whether the slot is still
+	// about the same enemy
+	struct Agent {
+		Entity entity = Entity::null();
+		float elapsed_ms = 0.f;	// since the agent last ran, what its timers advance by when it runs
+		vec2 force = { 0.f, 0.f };	// AI force of its last run, applied again on the ticks it skips
+		bool scheduled = false;
+	};
+	// Picks the enemies that run their AI this tick and the ones that skip it
+	void schedule_agents(float elapsed_ms);
+	// The agent of an enemy if it runs its AI this tick, null if it skips it
+	const Agent* scheduled_agent(Entity entity) const;
+	// Keeps the forces of the agents that ran, and applies the kept force to the ones that skipped
+	void finish_agents(float run_us);
+
+	std::vector<Agent> agents;
+	std::vector<unsigned int> far_agents;	// indices in agents
+	unsigned int lod_tick = 0;
+	float agent_cost_us = 0.f;	// moving average of the AI time per agent that ran
+	AILodCounters lod_counters;
 };
@@ -57,6 +57,10 @@ const bool SHOW_DIALOGS = DEBUG_MODE ? false : true;
 const bool MOVE_ENEMIES = DEBUG_MODE ? false : true;
 
 const int TARGET_REFRESH_RATE = 60;
+// The simulation advances in fixed ticks, independent of the frame rate. A frame runs at most
+// MAX_SIMULATION_SUBSTEPS ticks and drops the rest of its time, so a slow frame cannot snowball
+const float SIMULATION_TICK_RATE = 60.f;	// Ticks per second
+const int MAX_SIMULATION_SUBSTEPS = 8;
 // This is the "in-game" screen
 const int CONTENT_WIDTH_PX = 1920;
 const int CONTENT_HEIGHT_PX = 1080;
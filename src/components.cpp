@@ -5,6 +5,7 @@
 #include "../ext/stb_image/stb_image.h"
 
 // stlib
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -134,3 +135,71 @@ bool Mesh::loadFromOBJFile(std::string obj_path, std::vector<TexturedVertex>& ou
 	
 	return true;
 }
+
+// Triangles per leaf of the mesh BVH
+const uint16_t MESH_BVH_LEAF_SIZE = 2;
+
+static vec2 triangle_vertex(const Mesh& mesh, uint16_t index)
+{
+	return vec2(mesh.texture_vertices[mesh.vertex_indices[index]].position);
+}
+
+// Bounds the triangles bvh_triangles[first, first + count) with `node`, and splits them at the median
+// centroid along the longer side of their bounds until the leaves are small enough
+static void build_bvh_node(Mesh& mesh, uint16_t node, uint16_t first, uint16_t count, int depth)
+{
+	assert(depth < 32 && "Mesh BVH is deeper than the query stack allows");
+	vec2 box_min = vec2(INFINITY), box_max = vec2(-INFINITY);
+	vec2 centroid_min = vec2(INFINITY), centroid_max = vec2(-INFINITY);
+	for (uint16_t k = first; k < first + count; k++) {
+		uint16_t triangle = mesh.bvh_triangles[k];
+		vec2 centroid = vec2(0.f);
+		for (uint16_t v = 0; v < 3; v++) {
+			vec2 vertex = triangle_vertex(mesh, triangle + v);
+			box_min = min(box_min, vertex);
+			box_max = max(box_max, vertex);
+			centroid += vertex / 3.f;
+		}
+		centroid_min = min(centroid_min, centroid);
+		centroid_max = max(centroid_max, centroid);
+	}
+	mesh.bvh[node].box_min = box_min;
+	mesh.bvh[node].box_max = box_max;
+	if (count <= MESH_BVH_LEAF_SIZE) {
+		mesh.bvh[node].first = first;
+		mesh.bvh[node].count = count;
+		return;
+	}
+
+	int axis = (centroid_max.x - centroid_min.x >= centroid_max.y - centroid_min.y) ? 0 : 1;
+	uint16_t half = count / 2;
+	std::nth_element(mesh.bvh_triangles.begin() + first, mesh.bvh_triangles.begin() + first + half, mesh.bvh_triangles.begin() + first + count,
+		[&mesh, axis](uint16_t a, uint16_t b) {
+			float centroid_a = triangle_vertex(mesh, a)[axis] + triangle_vertex(mesh, a + 1)[axis] + triangle_vertex(mesh, a + 2)[axis];
+			float centroid_b = triangle_vertex(mesh, b)[axis] + triangle_vertex(mesh, b + 1)[axis] + triangle_vertex(mesh, b + 2)[axis];
+			return centroid_a < centroid_b;
+		});
+
+	uint16_t children = (uint16_t)mesh.bvh.size();
+	mesh.bvh.push_back(MeshBVHNode());
+	mesh.bvh.push_back(MeshBVHNode());
+	mesh.bvh[node].first = children;
+	mesh.bvh[node].count = 0;
+	build_bvh_node(mesh, children, first, half, depth + 1);
+	build_bvh_node(mesh, children + 1, first + half, count - half, depth + 1);
+}
+
+void Mesh::buildBVH()
+{
+	bvh_triangles.clear();
+	bvh.clear();
+	size_t triangle_count = vertex_indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+	assert(triangle_count < 0x7FFF && "Too many triangles for 16 bit BVH node indices");
+	for (size_t i = 0; i < triangle_count; i++)
+		bvh_triangles.push_back((uint16_t)(i * 3));
+	bvh.reserve(2 * triangle_count);
+	bvh.push_back(MeshBVHNode());
+	build_bvh_node(*this, 0, 0, (uint16_t)triangle_count, 0);
+}
@@ -65,6 +65,38 @@ enum class COLLISION_TYPE {
 	SWORD_WITH_CYST = SWORD_WITH_ENEMY + 1
 };
 
+// Where a collision between two entities is in its lifetime, see ContactManager
+enum class CONTACT_STATE {
+	BEGIN = 0,	// first step the two touch
+	STAY = BEGIN + 1,	// still touching since an earlier step
+	END = STAY + 1	// touched in the previous step, not anymore
+};
+
+// What an entity is to the collision filter, see CollisionFilter
+enum class COLLISION_CATEGORY {
+	NONE = 0,	// never reports or receives collision events with other entities
+	PROJECTILE = NONE + 1,
+	PLAYER = PROJECTILE + 1,
+	ENEMY = PLAYER + 1,
+	SWORD = ENEMY + 1,
+	CYST = SWORD + 1,
+	CHEST = CYST + 1,
+	CURE = CHEST + 1,
+	CATEGORY_COUNT = CURE + 1
+};
+const int collision_category_count = (int)COLLISION_CATEGORY::CATEGORY_COUNT;
+
+// Bits of CollisionFilter::layers
+const uint8_t COLLIDE_PLAYERS_LAYER = 1 << 0;	// has CollidePlayer
+const uint8_t COLLIDE_ENEMIES_LAYER = 1 << 1;	// has CollideEnemy
+
+// Primitive approximating the collision region of an entity, see ColliderShape
+enum class COLLIDER_PRIMITIVE {
+	CIRCLES = 0,		// chain of circles along the longer edge of the bounding box (the default)
+	CAPSULE = CIRCLES + 1,	// segment along the longer edge, rounded by half the shorter edge
+	BOX = CAPSULE + 1		// the rotated bounding box
+};
+
 enum class CYST_EFFECT_ID {
 	// POSITIVE EFFECTS
 	DAMAGE = 0,
@@ -381,6 +413,33 @@ static std::unordered_map <ENEMY_ID, float> enemy_health_map_regular = {
 	{ENEMY_ID::YELLOW, 50.f},
 	{ENEMY_ID::ENEMY_COUNT, 100.f}
 };
+
+// Expected peak component counts of a game mode. The containers reserve these when the mode is set,
+// so a bullet storm or a boss fight does not grow them mid-fight
+struct CapacityBudget {
+	int enemies;
+	int projectiles;
+	int movables;			// Transform and Motion
+	int render_requests;
+	int collisions;
+};
+
+const int BOSS_ENEMY_BUDGET = 32;		// Bosses, boss arms and clones alive at once
+const int PROJECTILE_BUDGET = 512;
+const int STATIC_ENTITY_BUDGET = 256;	// Cysts, regions, chests, waypoints and UI elements
+const int COLLISION_BUDGET = 256;
+
+// Enemies are capped per type by the game mode, everything else is shared by all modes
+inline CapacityBudget make_capacity_budget(int max_green, int max_red, int max_yellow) {
+	int enemies = max_green + max_red + max_yellow + BOSS_ENEMY_BUDGET;
+	int movables = STATIC_ENTITY_BUDGET + enemies + PROJECTILE_BUDGET;
+	return { enemies, PROJECTILE_BUDGET, movables, movables, COLLISION_BUDGET };
+}
+
+static std::unordered_map <GAME_MODE_ID, CapacityBudget> capacity_budgets = {
+	{GAME_MODE_ID::EASY_MODE, make_capacity_budget(max_green_easyMode, max_red_easyMode, max_yellow_easyMode)},
+	{GAME_MODE_ID::REGULAR_MODE, make_capacity_budget(max_green_regularMode, max_red_regularMode, max_yellow_regularMode)}
+};
 #pragma endregion
 
 #pragma region Components
@@ -430,9 +489,72 @@ struct Motion {
 	bool allow_accel = true;
 };
 
+// Transform and Motion are read by every movement and collision loop, mostly just position and velocity,
+// so they are stored as structure-of-arrays. get() returns these reference proxies instead of Transform& / Motion&.
+// Like Transform& / Motion&, a proxy is invalid after an insert into either container (see OwningGroup).
+struct TransformRef {
+	vec2& position;
+	vec2& scale;
+	float& angle;
+	bool& is_screen_coord;
+	float& angle_offset;
+	soa_ref_check check;
+
+	operator Transform() const { return { position, scale, angle, is_screen_coord, angle_offset }; }
+};
+
+struct MotionRef {
+	vec2& velocity;
+	float& angular_velocity;
+	vec2& force;
+	float& max_velocity;
+	float& max_angular_velocity;
+	float& acceleration_unit;
+	float& deceleration_unit;
+	bool& allow_accel;
+	soa_ref_check check;
+
+	operator Motion() const { return { velocity, angular_velocity, force, max_velocity, max_angular_velocity, acceleration_unit, deceleration_unit, allow_accel }; }
+};
+
+template <>
+struct storage_policy<Transform> {
+	using type = SoA;
+};
+
+template <>
+struct soa_layout<Transform> {
+	using fields = type_list<
+		soa_field<Transform, vec2, &Transform::position>,
+		soa_field<Transform, vec2, &Transform::scale>,
+		soa_field<Transform, float, &Transform::angle>,
+		soa_field<Transform, bool, &Transform::is_screen_coord>,
+		soa_field<Transform, float, &Transform::angle_offset>>;
+	using reference = TransformRef;
+};
+
+template <>
+struct storage_policy<Motion> {
+	using type = SoA;
+};
+
+template <>
+struct soa_layout<Motion> {
+	using fields = type_list<
+		soa_field<Motion, vec2, &Motion::velocity>,
+		soa_field<Motion, float, &Motion::angular_velocity>,
+		soa_field<Motion, vec2, &Motion::force>,
+		soa_field<Motion, float, &Motion::max_velocity>,
+		soa_field<Motion, float, &Motion::max_angular_velocity>,
+		soa_field<Motion, float, &Motion::acceleration_unit>,
+		soa_field<Motion, float, &Motion::deceleration_unit>,
+		soa_field<Motion, bool, &Motion::allow_accel>>;
+	using reference = MotionRef;
+};
+
 struct Attachment {
 	ATTACHMENT_ID type;
-	Entity parent;
+	Entity parent = Entity::null();
 	Transformation relative_transform_1;	// Before rotation
 	float moved_angle = 0.f;				// Rotation
 	Transformation relative_transform_2;	// After rotation
@@ -448,8 +570,9 @@ struct PlayerAbility {
 struct Collision {
 	// Note, the first object is stored in the ECS container.entities
 	COLLISION_TYPE collision_type;
-	Entity other_entity; // the second object involved in the collision
+	Entity other_entity = Entity::null(); // the second object involved in the collision
 	vec2 knockback_dir;
+	CONTACT_STATE state = CONTACT_STATE::BEGIN; // boundary collisions are always BEGIN
 	Collision(COLLISION_TYPE collision_type, Entity& other_entity) {
 		this->other_entity = other_entity;
 		this->collision_type = collision_type;
@@ -501,6 +624,13 @@ struct TexturedVertex {
 	vec2 texcoord;
 };
 
+// Node of the bounding volume hierarchy over the triangles of a mesh, in the mesh's local coordinates
+struct MeshBVHNode {
+	vec2 box_min, box_max;
+	uint16_t first;	// leaf: first entry in Mesh::bvh_triangles, inner node: left child (the right one follows it)
+	uint16_t count;	// number of triangles of a leaf, 0 for inner nodes
+};
+
 // Mesh datastructure for storing vertex and index buffers
 struct Mesh {
 	static bool loadFromOBJFile(std::string obj_path, std::vector<TexturedVertex>& out_vertices, std::vector<uint16_t>& out_vertex_indices, vec2& out_size, 
@@ -509,6 +639,37 @@ struct Mesh {
 	std::vector<TexturedVertex> texture_vertices;
 	std::vector<uint16_t> vertex_indices;
 	std::vector<ColoredVertex> color_vertices;
+
+	// Triangles (their first index in vertex_indices) grouped by leaf, and the hierarchy over them.
+	// Built once after loading for the meshes used as colliders
+	std::vector<uint16_t> bvh_triangles;
+	std::vector<MeshBVHNode> bvh;
+	void buildBVH();
+
+	// Calls fn(first_index) for the triangles whose local bounding box overlaps [box_min, box_max],
+	// stops and returns true as soon as fn returns true
+	template <typename Fn>
+	bool queryBVH(vec2 box_min, vec2 box_max, Fn fn) const {
+		if (bvh.empty())
+			return false;
+		uint16_t stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const MeshBVHNode& node = bvh[stack[--top]];
+			if (node.box_min.x > box_max.x || node.box_max.x < box_min.x || node.box_min.y > box_max.y || node.box_max.y < box_min.y)
+				continue;
+			if (node.count > 0) {
+				for (uint16_t k = node.first; k < node.first + node.count; k++)
+					if (fn(bvh_triangles[k]))
+						return true;
+			} else {
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+			}
+		}
+		return false;
+	}
 };
 
 struct RenderRequest {
@@ -533,6 +694,7 @@ struct Chest {
     bool isOpened = false;
     vec2 position;
 	bool waveActivated = false;
+	bool isTouched = false;	// by the player, set when their contact begins and cleared when it ends
 };
 
 struct Cure {
@@ -584,6 +746,31 @@ struct Cyst {
 	float sword_attack_cd = 0.f;
 };
 
+// Precomputed from the other components by update_collision_filter, so physics can pick the collision
+// event of a pair from a table before any shape test. Entities without it use COLLISION_CATEGORY::NONE
+struct CollisionFilter {
+	COLLISION_CATEGORY category = COLLISION_CATEGORY::NONE;
+	uint8_t layers = 0;
+};
+
+// Collision primitive of entities that are not approximated well by a few circles,
+// entities without it use COLLIDER_PRIMITIVE::CIRCLES
+struct ColliderShape {
+	COLLIDER_PRIMITIVE primitive = COLLIDER_PRIMITIVE::CIRCLES;
+};
+
+// Never moves once created (cysts, chests, the cure). Collides without a Motion through
+// the static index of the physics system, so its transform must not change after creation
+struct StaticCollider {
+
+};
+
+// Fast movers (projectiles, dashers) are tested for collisions over the whole path of their last step,
+// from position - displacement to position, so they cannot pass through thin entities between two steps
+struct SweptCollider {
+	vec2 displacement = { 0.f, 0.f };	// Set by the physics system
+};
+
 struct CollidePlayer {
 
 };
@@ -619,7 +806,7 @@ struct Gun {
 };
 
 struct Melee {
-	Entity melee_entity;
+	Entity melee_entity = Entity::null();
 	float damage = 40.f;
 	float attack_timer = 0.f;
 	float animation_timer = 0.f;
@@ -629,7 +816,7 @@ struct Melee {
 
 // Icons corresponding to interest point
 struct Waypoint {
-	Entity target; // Chest or boss. Can be removed from game
+	Entity target = Entity::null(); // Chest or boss. Can be removed from game
 	REGION_GOAL_ID goal = REGION_GOAL_ID::REGION_GOAL_COUNT;
 	vec2 interest_point;
 	vec2 icon_scale = { 20.f, 20.f };
@@ -642,8 +829,8 @@ struct Boss {
 struct Credits {
 	float timer = 0.f;
 	float total_time = 18000.f;
-	Entity background;
-	Entity title;
+	Entity background = Entity::null();
+	Entity title = Entity::null();
 };
 
 struct GameMode {
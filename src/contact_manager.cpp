@@ -0,0 +1,95 @@
+// internal
+#include "contact_manager.hpp"
+
+#include <algorithm>
+
+void ContactManager::PairIndex::reset(size_t expected)
+{
+	// keep the load factor at most 1/2
+	size_t capacity = 64;
+	while (capacity < expected * 2)
+		capacity *= 2;
+	if (keys.size() < capacity) {
+		keys.resize(capacity);
+		values.resize(capacity);
+	}
+	std::fill(keys.begin(), keys.end(), 0);
+	shift = 64;
+	for (size_t size = keys.size(); size > 1; size /= 2)
+		shift--;
+}
+
+unsigned int ContactManager::PairIndex::find(uint64_t key) const
+{
+	if (keys.empty())
+		return NOT_FOUND;
+	size_t mask = keys.size() - 1;
+	for (size_t k = home(key); keys[k] != 0; k = (k + 1) & mask) {
+		if (keys[k] == key)
+			return values[k];
+	}
+	return NOT_FOUND;
+}
+
+void ContactManager::PairIndex::insert(uint64_t key, unsigned int value)
+{
+	size_t mask = keys.size() - 1;
+	size_t k = home(key);
+	while (keys[k] != 0)
+		k = (k + 1) & mask;
+	keys[k] = key;
+	values[k] = value;
+}
+
+void ContactManager::begin_step()
+{
+	current.clear();
+	current_index.reset(previous.size());
+	previous_seen.assign(previous.size(), 0);
+}
+
+void ContactManager::touch(Entity entity_1, Entity entity_2, COLLISION_TYPE type, bool report_stay)
+{
+	uint64_t key = pair_key(entity_1, entity_2);
+	if (current_index.find(key) != PairIndex::NOT_FOUND)
+		return;
+
+	// grow before the table passes half full, the keys are rebuilt from the contacts
+	if ((current.size() + 1) * 2 > current_index.keys.size()) {
+		current_index.reset(current.size() + 1);
+		for (unsigned int c = 0; c < current.size(); c++)
+			current_index.insert(pair_key(current[c].entity_1, current[c].entity_2), c);
+	}
+
+	CONTACT_STATE state = CONTACT_STATE::BEGIN;
+	unsigned int p = previous_index.find(key);
+	if (p != PairIndex::NOT_FOUND && previous[p].state != CONTACT_STATE::END) {
+		state = CONTACT_STATE::STAY;
+		previous_seen[p] = 1;
+	}
+	current_index.insert(key, (unsigned int)current.size());
+	current.push_back({ entity_1, entity_2, type, state, report_stay });
+}
+
+void ContactManager::end_step()
+{
+	// Ended contacts stay in the buffer for one step only, so they are not indexed
+	for (unsigned int p = 0; p < previous.size(); p++) {
+		if (!previous_seen[p] && previous[p].state != CONTACT_STATE::END) {
+			Contact ended = previous[p];
+			ended.state = CONTACT_STATE::END;
+			current.push_back(ended);
+		}
+	}
+	std::swap(current, previous);
+	std::swap(current_index, previous_index);
+}
+
+void ContactManager::clear()
+{
+	current.clear();
+	previous.clear();
+	previous_seen.clear();
+	current_index.reset(0);
+	previous_index.reset(0);
+}
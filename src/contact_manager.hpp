@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "tiny_ecs.hpp"
+#include "components.hpp"
+
+// Touching pairs of entities kept across steps, so a contact is reported when it begins, while it stays and
+// when it ends instead of once per step. Pairs are ordered: entity_1 receives the event of the pair.
+// Every step: begin_step(), touch() every pair found touching, then end_step(). The pair buffers and their
+// index are swapped between steps and keep their capacity, so steady-state steps do not allocate.
+class ContactManager
+{
+public:
+	struct Contact {
+		Entity entity_1 = Entity::null();
+		Entity entity_2 = Entity::null();
+		COLLISION_TYPE type;
+		CONTACT_STATE state;
+		bool report_stay;	// gameplay also reacts to the steps between BEGIN and END
+	};
+
+	void begin_step();
+
+	// Records that entity_1 touches entity_2 this step, touching the same pair again in a step does nothing
+	void touch(Entity entity_1, Entity entity_2, COLLISION_TYPE type, bool report_stay);
+
+	// Adds an END contact for every pair touched in the previous step and not in this one
+	void end_step();
+
+	// The contacts of the last finished step: the touching ones in the order they were first touched,
+	// then the ones that ended
+	const std::vector<Contact>& get_contacts() const { return previous; }
+
+	// Forget every contact without reporting their end, e.g. when the world is reset
+	void clear();
+
+private:
+	// Open addressing table from a pair key to its index in a contact buffer, key 0 marks a free slot
+	// (entity 0 is the null entity and never touches anything)
+	struct PairIndex {
+		std::vector<uint64_t> keys;
+		std::vector<unsigned int> values;
+		unsigned int shift = 64;	// 64 - log2(keys.size())
+
+		static const unsigned int NOT_FOUND = UINT32_MAX;
+		void reset(size_t expected);
+		unsigned int find(uint64_t key) const;
+		void insert(uint64_t key, unsigned int value);
+		size_t home(uint64_t key) const { return (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift); }
+	};
+
+	static uint64_t pair_key(Entity entity_1, Entity entity_2) {
+		return ((uint64_t)(unsigned int)entity_1 << 32) | (unsigned int)entity_2;
+	}
+
+	std::vector<Contact> current, previous;
+	PairIndex current_index, previous_index;
+	std::vector<uint8_t> previous_seen;	// whether each previous contact was touched again this step
+};
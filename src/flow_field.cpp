@@ -0,0 +1,171 @@
+// internal
+#include "flow_field.hpp"
+
+#include <algorithm>
+
+namespace {
+	// Neighbour offsets, the sides first
+	const int NEIGHBOUR_X[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	const int NEIGHBOUR_Y[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+}
+
+FlowField::FlowField(float cell_size, float range)
+	: cell_size(cell_size), max_cost((unsigned int)(range / cell_size * STRAIGHT_COST))
+{
+	cells_per_side = (int)ceilf(2 * MAP_RADIUS / cell_size);
+	unsigned int cell_count = (unsigned int)(cells_per_side * cells_per_side);
+	blocked.resize(cell_count);
+	costs.assign(cell_count, UNREACHABLE);
+	directions.assign(cell_count, vec2(0.f));
+	buckets.resize(DIAGONAL_COST + 1);
+	clear_obstacles();
+}
+
+int FlowField::cell_of(float coordinate) const
+{
+	return (int)floorf((coordinate + MAP_RADIUS) / cell_size);
+}
+
+void FlowField::clear_obstacles()
+{
+	// A cell is outside the map when its center is
+	for (int y = 0; y < cells_per_side; y++)
+		for (int x = 0; x < cells_per_side; x++) {
+			vec2 center = (vec2(x, y) + 0.5f) * cell_size - MAP_RADIUS;
+			blocked[index(x, y)] = dot(center, center) > MAP_RADIUS * MAP_RADIUS;
+		}
+	obstacles_changed = true;
+}
+
+void FlowField::block_circle(vec2 center, float radius)
+{
+	int min_x = std::max(cell_of(center.x - radius), 0);
+	int min_y = std::max(cell_of(center.y - radius), 0);
+	int max_x = std::min(cell_of(center.x + radius), cells_per_side - 1);
+	int max_y = std::min(cell_of(center.y + radius), cells_per_side - 1);
+	for (int y = min_y; y <= max_y; y++)
+		for (int x = min_x; x <= max_x; x++) {
+			// closest point of the cell to the circle center
+			vec2 cell_min = vec2(x, y) * cell_size - MAP_RADIUS;
+			vec2 offset = center - clamp(center, cell_min, cell_min + cell_size);
+			if (dot(offset, offset) < radius * radius)
+				blocked[index(x, y)] = 1;
+		}
+	obstacles_changed = true;
+}
+
+bool FlowField::update(vec2 target)
+{
+	int x = std::min(std::max(cell_of(target.x), 0), cells_per_side - 1);
+	int y = std::min(std::max(cell_of(target.y), 0), cells_per_side - 1);
+	unsigned int cell = index(x, y);
+	if (cell == target_cell && !obstacles_changed)
+		return false;
+	target_cell = cell;
+	obstacles_changed = false;
+	compute_costs(cell);
+	compute_directions();
+	return true;
+}
+
+// Dijkstra from the target cell. The costs are small integers, so the queue is a ring of buckets by cost
+void FlowField::compute_costs(unsigned int target)
+{
+	for (unsigned int cell : reached) {
+		costs[cell] = UNREACHABLE;
+		directions[cell] = vec2(0.f);
+	}
+	reached.clear();
+	for (std::vector<unsigned int>& bucket : buckets)
+		bucket.clear();
+
+	// the target can stand in a blocked cell, e.g. against a cyst, it is still where the paths lead
+	costs[target] = 0;
+	buckets[0].push_back(target);
+	size_t queued = 1;
+	for (unsigned int cost = 0; queued > 0; cost++) {
+		std::vector<unsigned int>& bucket = buckets[cost % buckets.size()];
+		// relaxing from this bucket only adds to the others, as every move costs at least 1
+		for (size_t k = 0; k < bucket.size(); k++) {
+			unsigned int cell = bucket[k];
+			if (costs[cell] != cost)
+				continue;	// reached more cheaply since it was queued
+			reached.push_back(cell);
+			int x = (int)(cell % cells_per_side);
+			int y = (int)(cell / cells_per_side);
+			for (int n = 0; n < 8; n++) {
+				int nx = x + NEIGHBOUR_X[n];
+				int ny = y + NEIGHBOUR_Y[n];
+				if (!inside(nx, ny) || blocked[index(nx, ny)])
+					continue;
+				// no cutting the corner of an obstacle
+				if (n >= 4 && (blocked[index(nx, y)] || blocked[index(x, ny)]))
+					continue;
+				unsigned int next_cost = cost + (n < 4 ? STRAIGHT_COST : DIAGONAL_COST);
+				unsigned int next = index(nx, ny);
+				if (next_cost <= max_cost && next_cost < costs[next]) {
+					costs[next] = next_cost;
+					buckets[next_cost % buckets.size()].push_back(next);
+					queued++;
+				}
+			}
+		}
+		queued -= bucket.size();
+		bucket.clear();
+	}
+}
+
+void FlowField::compute_directions()
+{
+	for (unsigned int cell : reached) {
+		if (costs[cell] == 0)
+			continue;
+		int x = (int)(cell % cells_per_side);
+		int y = (int)(cell / cells_per_side);
+		unsigned int best_cost = costs[cell];
+		for (int n = 0; n < 8; n++) {
+			int nx = x + NEIGHBOUR_X[n];
+			int ny = y + NEIGHBOUR_Y[n];
+			if (!inside(nx, ny) || costs[index(nx, ny)] >= best_cost)
+				continue;
+			if (n >= 4 && (blocked[index(nx, y)] || blocked[index(x, ny)]))
+				continue;
+			best_cost = costs[index(nx, ny)];
+			directions[cell] = normalize(vec2(NEIGHBOUR_X[n], NEIGHBOUR_Y[n]));
+		}
+	}
+}
+
+vec2 FlowField::direction(vec2 position) const
+{
+	// Bilinear blend of the four cells whose centers surround the position, skipping the ones without a direction
+	vec2 grid_position = (position + MAP_RADIUS) / cell_size - 0.5f;
+	int x0 = (int)floorf(grid_position.x);
+	int y0 = (int)floorf(grid_position.y);
+	vec2 fraction = grid_position - vec2(x0, y0);
+	vec2 sum = vec2(0.f);
+	for (int dy = 0; dy <= 1; dy++)
+		for (int dx = 0; dx <= 1; dx++) {
+			if (!inside(x0 + dx, y0 + dy))
+				continue;
+			float weight = (dx ? fraction.x : 1.f - fraction.x) * (dy ? fraction.y : 1.f - fraction.y);
+			sum += weight * directions[index(x0 + dx, y0 + dy)];
+		}
+	float sum2 = dot(sum, sum);
+	if (sum2 < 1e-6f) {
+		// opposite directions cancelled out, take the cell's own
+		int x = cell_of(position.x);
+		int y = cell_of(position.y);
+		return inside(x, y) ? directions[index(x, y)] : vec2(0.f);
+	}
+	return sum / sqrtf(sum2);
+}
+
+float FlowField::path_length(vec2 position) const
+{
+	int x = cell_of(position.x);
+	int y = cell_of(position.y);
+	if (!inside(x, y) || costs[index(x, y)] == UNREACHABLE)
+		return INFINITY;
+	return costs[index(x, y)] * cell_size / STRAIGHT_COST;
+}
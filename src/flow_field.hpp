@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+
+// Grid over the square around the map disc pointing every cell within a path length of range from a target
+// cell along the shortest path to it, so any number of enemies can follow paths around the obstacles by
+// sampling it. Cells outside the map and the ones marked with block_circle() are obstacles.
+// Mark the obstacles after clear_obstacles(), then update() with the target every step. The paths are only
+// searched again when the target moved to another cell or the obstacles changed, and only the cells the
+// previous search reached are reset.
+class FlowField
+{
+public:
+	FlowField(float cell_size, float range);
+
+	// Unblocks every cell inside the map
+	void clear_obstacles();
+	// Blocks the cells the circle overlaps
+	void block_circle(vec2 center, float radius);
+
+	// Recomputes the field if target is in another cell than last time or the obstacles changed.
+	// Returns whether it did
+	bool update(vec2 target);
+
+	// Unit direction along the path from position to the target, blended over the nearest cells.
+	// {0, 0} in the target cell and where the target cannot be reached within range
+	vec2 direction(vec2 position) const;
+
+	// Length of the path from the cell of position to the target cell, INFINITY if there is none within range
+	float path_length(vec2 position) const;
+
+	float get_cell_size() const { return cell_size; }
+
+private:
+	static const unsigned int UNREACHABLE = ~0u;
+	// Path costs of a move to a side and to a corner neighbour, in fifths of a cell
+	static const unsigned int STRAIGHT_COST = 5;
+	static const unsigned int DIAGONAL_COST = 7;
+
+	int cell_of(float coordinate) const;
+	bool inside(int x, int y) const { return x >= 0 && y >= 0 && x < cells_per_side && y < cells_per_side; }
+	unsigned int index(int x, int y) const { return (unsigned int)(y * cells_per_side + x); }
+	void compute_costs(unsigned int target);
+	void compute_directions();
+
+	float cell_size;
+	unsigned int max_cost;
+	int cells_per_side;
+	std::vector<unsigned char> blocked;
+	std::vector<unsigned int> costs;	// path cost to the target cell
+	std::vector<vec2> directions;	// towards the neighbour with the lowest cost
+	std::vector<unsigned int> reached;	// cells with a cost, in the order the search reached them
+
+	unsigned int target_cell = UNREACHABLE;
+	bool obstacles_changed = true;
+
+	// Buckets of the Dijkstra queue by cost modulo DIAGONAL_COST + 1, kept to reuse their capacity
+	std::vector<std::vector<unsigned int>> buckets;
+};
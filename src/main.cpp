@@ -14,8 +14,9 @@
 using Clock = std::chrono::high_resolution_clock;
 
 void reset_forces() {
-	for (Motion& m : registry.motions.components) {
-		m.force = { 0.f, 0.f };
+	vec2* forces = registry.motions.field(&Motion::force);
+	for (size_t i = 0; i < registry.motions.size(); i++) {
+		forces[i] = { 0.f, 0.f };
 	}
 }
 
@@ -40,10 +41,13 @@ int main()
 
 	// initialize the main systems
 	render_system.init(window);
-	world_system.init(&render_system);
+	world_system.init(&render_system, &physics_system);
 	render_system.animationSys_init();
 
-	// variable timestep loop
+	// fixed timestep loop: the frame's time is spent in ticks of tick_ms, the remainder carries over
+	// to the next frame and the frame is drawn that far between the last two ticks
+	const float tick_ms = 1000.f / SIMULATION_TICK_RATE;
+	float accumulated_ms = 0.f;
 	auto t = Clock::now();
 	while (!world_system.is_over()) {
 		// Processes system messages, if this wasn't present the window would become unresponsive
@@ -54,23 +58,36 @@ int main()
 		float elapsed_ms =
 			(float)(std::chrono::duration_cast<std::chrono::microseconds>(now - t)).count() / 1000;
 		t = now;
+		accumulated_ms += elapsed_ms;
 
-		reset_forces();
-		bool isRunning = world_system.step(elapsed_ms);
-		if (isRunning) {
-			ai_system.step(elapsed_ms);
-			physics_system.step(elapsed_ms);
-			world_system.resolve_collisions();
-			render_system.animationSys_step(elapsed_ms);
-			world_system.update_camera(elapsed_ms);
+		for (int substep = 0; substep < MAX_SIMULATION_SUBSTEPS && accumulated_ms >= tick_ms; substep++) {
+			accumulated_ms -= tick_ms;
+			render_system.save_previous_transforms();
+
+			reset_forces();
+			bool isRunning = world_system.step(tick_ms);
+			if (isRunning) {
+				ai_system.step(tick_ms);
+				physics_system.step(tick_ms);
+				world_system.resolve_collisions();
+				render_system.animationSys_step(tick_ms);
+				world_system.update_camera(tick_ms);
+			}
+			// Sync point: apply the entity destroys and component changes recorded during the step
+			registry.flush_pending();
+		}
+		// Too far behind, drop the ticks the frame could not run instead of owing them to the next one
+		if (accumulated_ms >= tick_ms) {
+			accumulated_ms = fmodf(accumulated_ms, tick_ms);
 		}
-		
-		render_system.draw();
+
+		render_system.draw(accumulated_ms / tick_ms);
 	}
 
 	// Debugging for memory/component leaks
 	printf("\n=========================\n|\tEnding\t\t|\n=========================\n");
 	registry.list_all_components();
+	registry.list_high_water_marks();
 
 	return EXIT_SUCCESS;
 }
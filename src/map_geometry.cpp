@@ -0,0 +1,67 @@
+// internal
+#include "map_geometry.hpp"
+
+#include <numeric>
+#include <cassert>
+
+MapGeometry map_geometry;
+
+float MapGeometry::pseudo_angle(vec2 point)
+{
+	float sum = std::abs(point.x) + std::abs(point.y);
+	if (sum == 0.f)
+		return 0.f;
+	// goes from 0 to 1 through the first quadrant like the angle does, and on through the others
+	float p = point.y / sum;
+	if (point.x < 0.f)
+		return 2.f - p;
+	if (point.y < 0.f)
+		return 4.f + p;
+	return p;
+}
+
+void MapGeometry::build(const std::vector<float>& start_angles)
+{
+	clear();
+	if (start_angles.empty())
+		return;
+
+	std::vector<unsigned int> order(start_angles.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&start_angles](unsigned int a, unsigned int b) {
+		return start_angles[a] < start_angles[b];
+	});
+
+	// The last sector ends where the first one starts. Every sector has to be narrower than PI
+	// for the edge normals to point into it
+	for (unsigned int k = 0; k < order.size(); k++) {
+		float start_angle = start_angles[order[k]];
+		float end_angle = k + 1 < order.size() ? start_angles[order[k + 1]] : start_angles[order[0]] + 2 * M_PI;
+		assert(start_angle >= 0.f && start_angle < 2 * M_PI);
+		assert(end_angle - start_angle < M_PI);
+
+		Sector sector;
+		sector.region = order[k];
+		sector.start_edge = { cosf(start_angle), sinf(start_angle) };
+		sector.end_edge = { cosf(end_angle), sinf(end_angle) };
+		sector.start_normal = { -sector.start_edge.y, sector.start_edge.x };
+		sector.end_normal = { sector.end_edge.y, -sector.end_edge.x };
+		sectors.push_back(sector);
+		start_pseudo_angles.push_back(pseudo_angle(sector.start_edge));
+	}
+}
+
+void MapGeometry::clear()
+{
+	sectors.clear();
+	start_pseudo_angles.clear();
+}
+
+unsigned int MapGeometry::sector_of(vec2 point) const
+{
+	if (sectors.empty())
+		return NO_SECTOR;
+	// before the first start edge is the part of the last sector that wraps around 0
+	size_t k = std::upper_bound(start_pseudo_angles.begin(), start_pseudo_angles.end(), pseudo_angle(point)) - start_pseudo_angles.begin();
+	return k == 0 ? (unsigned int)sectors.size() - 1 : (unsigned int)k - 1;
+}
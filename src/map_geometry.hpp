@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "common.hpp"
+
+// Geometry of the circular map and its region sectors, built once when the regions are created so
+// boundary and sector queries need no trigonometry or square roots. Only reads its own tables,
+// so the collision tasks can query it in parallel.
+class MapGeometry
+{
+public:
+	static const unsigned int NO_SECTOR = ~0u;
+
+	// A region of the map, the wedge between the edge it starts at and the edge the next one starts at
+	struct Sector {
+		unsigned int region;	// index of the region in registry.regions
+		vec2 start_edge, end_edge;	// unit directions of the edges from the map center
+		vec2 start_normal, end_normal;	// unit normals of the edges pointing into the sector
+	};
+
+	// start_angles are the angles the regions start at, in [0, 2PI) and in the order of registry.regions
+	void build(const std::vector<float>& start_angles);
+	void clear();
+
+	bool empty() const { return sectors.empty(); }
+	const Sector& sector(unsigned int s) const { return sectors[s]; }
+
+	// Sector the point is in, NO_SECTOR without regions. A point on an edge is in the sector the edge starts
+	unsigned int sector_of(vec2 point) const;
+
+	// Whether a circle reaches past the map boundary
+	static bool outside_map(vec2 center, float radius) {
+		float inner = MAP_RADIUS - radius;
+		return inner < 0.f || dot(center, center) > inner * inner;
+	}
+
+	// Whether a circle overlaps the edge segment from the map center to the boundary in direction edge
+	static bool overlaps_edge(vec2 edge, vec2 center, float radius) {
+		float along = std::min(std::max(dot(center, edge), 0.f), MAP_RADIUS);
+		vec2 offset = center - along * edge;
+		return dot(offset, offset) < radius * radius;
+	}
+
+private:
+	// Monotonic in the angle of the point over [0, 2PI) without trigonometry, in [0, 4)
+	static float pseudo_angle(vec2 point);
+
+	std::vector<Sector> sectors;	// sorted by start angle
+	std::vector<float> start_pseudo_angles;	// pseudo_angle of each sector's start edge
+};
+
+extern MapGeometry map_geometry;
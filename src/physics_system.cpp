@@ -1,6 +1,10 @@
 // internal
 #include "physics_system.hpp"
 #include "world_init.hpp"
+#include "map_geometry.hpp"
+
+// stlib
+#include <array>
 
 // Returns the local bounding coordinates scaled by the current size of the entity
 vec2 get_bounding_box(const Transform& transform)
@@ -9,28 +13,19 @@ vec2 get_bounding_box(const Transform& transform)
 	return { abs(transform.scale.x), abs(transform.scale.y) };
 }
 
-struct CollisionCircle {
-	vec2 position;
-	float radius;
-	CollisionCircle(vec2 position, float radius) : 
-		position(position), 
-		radius(radius) 
-	{}
-};
-
 // A brief explanation of the collision detection algorithm used in functions below:
 // For a textured moving object, try to fit some number of circles within its bounding
 // box. These circles together represent the collision region of the entity. if any
 // collision circle of one entity collides with any collision circle of another entity,
 // then these two entities collide. This is a more accurate approximation when the
 // entity's bounding box is not square
-std::vector<CollisionCircle> get_collision_circles(const Transform& transform)
+// The circle positions are offsets from transform.position, they are appended to res
+void get_collision_circles(const Transform& transform, std::vector<CollisionCircle>& res)
 {
-	std::vector<CollisionCircle> res;
 	vec2 bounding_box = get_bounding_box(transform);
 	// If the bounding box is square, use a single circle
 	if (abs(bounding_box.x - bounding_box.y) < 0.0001f) {
-		res.push_back(CollisionCircle(transform.position, bounding_box.x / 2));
+		res.push_back(CollisionCircle(vec2(0.f), bounding_box.x / 2));
 	} else {
 		// Otherwise partition the rectangle into multiple circles
 		float shorter_edge = min(bounding_box.x, bounding_box.y); 
@@ -44,7 +39,7 @@ std::vector<CollisionCircle> get_collision_circles(const Transform& transform)
 			pos_offset = vec2(circle_pos, 0);
 			pos_offset = transformation.mat * vec3(pos_offset, 1.f);
 			res.push_back(CollisionCircle(
-				transform.position + vec2(pos_offset.x, pos_offset.y),
+				vec2(pos_offset.x, pos_offset.y),
 				shorter_edge / 2.f
 			));
 			circle_pos += shorter_edge / 4.f;
@@ -52,20 +47,230 @@ std::vector<CollisionCircle> get_collision_circles(const Transform& transform)
 		pos_offset = vec2(longer_edge / 2.f - shorter_edge / 2.f, 0);
 		pos_offset = transformation.mat * vec3(pos_offset, 1.f);
 		res.push_back(CollisionCircle(
-			transform.position + vec2(pos_offset.x, pos_offset.y),
+			vec2(pos_offset.x, pos_offset.y),
 			shorter_edge / 2.f
 		));
 	}
-	return res;
 }
 
-bool collides(const Transform& transform1, const Transform& transform2)
+void CollisionShapeCache::resize(unsigned int count)
+{
+	if (count > entries.size())
+		entries.resize(count, Entry{ vec2(0.f), 0.f, COLLIDER_PRIMITIVE::CIRCLES, 0, 0, 0, false, vec2(0.f), vec2(0.f), 0.f });
+}
+
+void CollisionShapeCache::update(unsigned int slot, const Transform& transform, COLLIDER_PRIMITIVE primitive)
+{
+	assert(slot < entries.size());
+	Entry& entry = entries[slot];
+	if (!entry.valid || entry.scale != transform.scale || entry.angle != transform.angle || entry.primitive != primitive) {
+		generated.clear();
+		get_collision_circles(transform, generated);
+		unsigned int count = (unsigned int)generated.size();
+		if (count > entry.capacity) {
+			// Does not fit in place, move to the end of the buffer
+			if (circles.size() + count > 2 * live + 64)
+				compact();
+			entry.offset = (unsigned int)circles.size();
+			entry.capacity = count;
+			circles.insert(circles.end(), generated.begin(), generated.end());
+		} else {
+			std::copy(generated.begin(), generated.end(), circles.begin() + entry.offset);
+		}
+		live += count;
+		live -= entry.valid ? entry.count : 0;
+		entry.count = count;
+		entry.scale = transform.scale;
+		entry.angle = transform.angle;
+		entry.valid = true;
+
+		// The primitives are aligned with the longer edge like the circles
+		vec2 bounding_box = get_bounding_box(transform);
+		float shorter_edge = min(bounding_box.x, bounding_box.y);
+		float longer_edge = max(bounding_box.x, bounding_box.y);
+		float angle = (bounding_box.x < bounding_box.y) ? (float)(M_PI / 2 + transform.angle) : transform.angle;
+		vec2 direction = { cosf(angle), sinf(angle) };
+		entry.primitive = primitive;
+		if (primitive == COLLIDER_PRIMITIVE::CAPSULE) {
+			entry.axis = direction * (longer_edge / 2.f - shorter_edge / 2.f);
+			entry.side = vec2(0.f);
+			entry.radius = shorter_edge / 2.f;
+		} else if (primitive == COLLIDER_PRIMITIVE::BOX) {
+			entry.axis = direction * (longer_edge / 2.f);
+			entry.side = vec2(-direction.y, direction.x) * (shorter_edge / 2.f);
+			entry.radius = 0.f;
+		}
+	}
+}
+
+// Pack the shapes in use to the front of the buffer
+void CollisionShapeCache::compact()
+{
+	compacted.clear();
+	for (Entry& entry : entries) {
+		if (!entry.valid) {
+			entry.capacity = 0;
+			continue;
+		}
+		unsigned int offset = (unsigned int)compacted.size();
+		compacted.insert(compacted.end(), circles.begin() + entry.offset, circles.begin() + entry.offset + entry.count);
+		entry.offset = offset;
+		entry.capacity = entry.count;
+	}
+	circles.swap(compacted);
+}
+
+// Closed-form tests for the capsule and box primitives. Boxes are centered at the origin
+// with half extent vectors axis and side, the points are relative to the box center
+
+// Squared distance from point p to the segment ab
+float point_segment_distance2(vec2 p, vec2 a, vec2 b)
+{
+	vec2 ab = b - a;
+	float length2 = dot(ab, ab);
+	float t = length2 > 0.f ? clamp(dot(p - a, ab) / length2, 0.f, 1.f) : 0.f;
+	vec2 d = p - (a + t * ab);
+	return dot(d, d);
+}
+
+// Squared distance between the segments p1q1 and p2q2
+// Reference: Ericson, Real-Time Collision Detection, 5.1.9
+float segment_segment_distance2(vec2 p1, vec2 q1, vec2 p2, vec2 q2)
+{
+	vec2 d1 = q1 - p1;
+	vec2 d2 = q2 - p2;
+	vec2 r = p1 - p2;
+	float a = dot(d1, d1);
+	float e = dot(d2, d2);
+	float f = dot(d2, r);
+	float s = 0.f, t = 0.f;
+	if (a <= 1e-6f && e <= 1e-6f) {
+		return dot(r, r);
+	}
+	if (a <= 1e-6f) {
+		t = clamp(f / e, 0.f, 1.f);
+	} else {
+		float c = dot(d1, r);
+		if (e <= 1e-6f) {
+			s = clamp(-c / a, 0.f, 1.f);
+		} else {
+			float b = dot(d1, d2);
+			float denom = a * e - b * b;
+			s = denom > 0.f ? clamp((b * f - c * e) / denom, 0.f, 1.f) : 0.f;
+			t = (b * s + f) / e;
+			if (t < 0.f) {
+				t = 0.f;
+				s = clamp(-c / a, 0.f, 1.f);
+			} else if (t > 1.f) {
+				t = 1.f;
+				s = clamp((b - c) / a, 0.f, 1.f);
+			}
+		}
+	}
+	vec2 d = (p1 + d1 * s) - (p2 + d2 * t);
+	return dot(d, d);
+}
+
+// Squared distance from point p to the box
+float point_box_distance2(vec2 p, vec2 axis, vec2 side)
+{
+	float half_axis = length(axis);
+	float half_side = length(side);
+	vec2 local = { half_axis > 0.f ? dot(p, axis) / half_axis : 0.f, half_side > 0.f ? dot(p, side) / half_side : 0.f };
+	vec2 excess = max(abs(local) - vec2(half_axis, half_side), vec2(0.f));
+	return dot(excess, excess);
+}
+
+// Separating axis test of two boxes whose centers are `offset` apart. A box with side = 0 is a segment
+bool boxes_overlap(vec2 offset, vec2 axis1, vec2 side1, vec2 axis2, vec2 side2)
+{
+	const vec2 edges[4] = { axis1, side1, axis2, side2 };
+	for (vec2 edge : edges) {
+		vec2 normal = { -edge.y, edge.x };
+		float extent1 = abs(dot(axis1, normal)) + abs(dot(side1, normal));
+		float extent2 = abs(dot(axis2, normal)) + abs(dot(side2, normal));
+		if (abs(dot(offset, normal)) > extent1 + extent2) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Squared distance between the segment ab and the box. Disjoint convex shapes are closest at a vertex of one of them
+float segment_box_distance2(vec2 a, vec2 b, vec2 axis, vec2 side)
+{
+	if (boxes_overlap((a + b) / 2.f, axis, side, (b - a) / 2.f, vec2(0.f))) {
+		return 0.f;
+	}
+	float distance2 = min(point_box_distance2(a, axis, side), point_box_distance2(b, axis, side));
+	const vec2 corners[4] = { axis + side, axis - side, -axis + side, -axis - side };
+	for (vec2 corner : corners) {
+		distance2 = min(distance2, point_segment_distance2(corner, a, b));
+	}
+	return distance2;
+}
+
+// Check a circle at world position `center` against a shape
+bool collides_with_circle(const CollisionShape& shape, vec2 center, float radius)
+{
+	vec2 p = center - shape.position;
+	switch (shape.primitive) {
+	case COLLIDER_PRIMITIVE::CAPSULE: {
+		float reach = shape.radius + radius;
+		return point_segment_distance2(p, -shape.axis, shape.axis) < reach * reach;
+	}
+	case COLLIDER_PRIMITIVE::BOX:
+		return point_box_distance2(p, shape.axis, shape.side) < radius * radius;
+	default:
+		for (unsigned int k = 0; k < shape.count; k++) {
+			const CollisionCircle& circle = shape.circles[k];
+			if (length(p - circle.position) < radius + circle.radius) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+// Capsule or box against capsule or box, `offset` is the position of shape2 relative to shape1
+bool primitives_collide(const CollisionShape& shape1, const CollisionShape& shape2, vec2 offset)
+{
+	if (shape1.primitive == COLLIDER_PRIMITIVE::BOX && shape2.primitive == COLLIDER_PRIMITIVE::BOX) {
+		return boxes_overlap(offset, shape1.axis, shape1.side, shape2.axis, shape2.side);
+	}
+	if (shape1.primitive == COLLIDER_PRIMITIVE::CAPSULE && shape2.primitive == COLLIDER_PRIMITIVE::CAPSULE) {
+		float reach = shape1.radius + shape2.radius;
+		return segment_segment_distance2(-shape1.axis, shape1.axis, offset - shape2.axis, offset + shape2.axis) < reach * reach;
+	}
+	if (shape1.primitive == COLLIDER_PRIMITIVE::BOX) {
+		return primitives_collide(shape2, shape1, -offset);
+	}
+	// capsule against box, relative to the box center
+	return segment_box_distance2(-offset - shape1.axis, -offset + shape1.axis, shape2.axis, shape2.side) < shape1.radius * shape1.radius;
+}
+
+bool collides(const CollisionShape& shape1, const CollisionShape& shape2)
 {
-	std::vector<CollisionCircle> circles1 = get_collision_circles(transform1);
-	std::vector<CollisionCircle> circles2 = get_collision_circles(transform2);
-	for (CollisionCircle circle1 : circles1) {
-		for (CollisionCircle circle2: circles2) {
-			float distance = length(circle1.position - circle2.position);
+	if (shape1.primitive != COLLIDER_PRIMITIVE::CIRCLES && shape2.primitive != COLLIDER_PRIMITIVE::CIRCLES) {
+		return primitives_collide(shape1, shape2, shape2.position - shape1.position);
+	}
+	if (shape1.primitive != COLLIDER_PRIMITIVE::CIRCLES || shape2.primitive != COLLIDER_PRIMITIVE::CIRCLES) {
+		// circles against a primitive
+		const CollisionShape& circles = shape1.primitive == COLLIDER_PRIMITIVE::CIRCLES ? shape1 : shape2;
+		const CollisionShape& primitive = shape1.primitive == COLLIDER_PRIMITIVE::CIRCLES ? shape2 : shape1;
+		for (unsigned int k = 0; k < circles.count; k++) {
+			if (collides_with_circle(primitive, circles.position + circles.circles[k].position, circles.circles[k].radius)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	for (unsigned int k1 = 0; k1 < shape1.count; k1++) {
+		const CollisionCircle& circle1 = shape1.circles[k1];
+		vec2 position1 = shape1.position + circle1.position;
+		for (unsigned int k2 = 0; k2 < shape2.count; k2++) {
+			const CollisionCircle& circle2 = shape2.circles[k2];
+			float distance = length(position1 - (shape2.position + circle2.position));
 			if (distance < circle1.radius + circle2.radius) {
 				return true;
 			}
@@ -74,19 +279,62 @@ bool collides(const Transform& transform1, const Transform& transform2)
 	return false;
 }
 
+// Check a circle moving from world position `start` to `end` against a shape, ie. the capsule it sweeps
+bool sweeps_circle(const CollisionShape& shape, vec2 start, vec2 end, float radius)
+{
+	vec2 a = start - shape.position;
+	vec2 b = end - shape.position;
+	switch (shape.primitive) {
+	case COLLIDER_PRIMITIVE::CAPSULE: {
+		float reach = shape.radius + radius;
+		return segment_segment_distance2(a, b, -shape.axis, shape.axis) < reach * reach;
+	}
+	case COLLIDER_PRIMITIVE::BOX:
+		return segment_box_distance2(a, b, shape.axis, shape.side) < radius * radius;
+	default:
+		for (unsigned int k = 0; k < shape.count; k++) {
+			const CollisionCircle& circle = shape.circles[k];
+			float reach = radius + circle.radius;
+			if (point_segment_distance2(circle.position, a, b) < reach * reach) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+// collides() over a step in which shape1 moved by `sweep` relative to shape2. The circles of one of them
+// are swept along the relative path, two capsules or boxes are only tested where they are now
+bool sweeps_collide(const CollisionShape& shape1, const CollisionShape& shape2, vec2 sweep)
+{
+	if (shape1.primitive == COLLIDER_PRIMITIVE::CIRCLES) {
+		for (unsigned int k = 0; k < shape1.count; k++) {
+			vec2 end = shape1.position + shape1.circles[k].position;
+			if (sweeps_circle(shape2, end - sweep, end, shape1.circles[k].radius)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	if (shape2.primitive == COLLIDER_PRIMITIVE::CIRCLES) {
+		return sweeps_collide(shape2, shape1, -sweep);
+	}
+	return collides(shape1, shape2);
+}
+
 //AABB-AABB collision is used
 //reference: https://developer.mozilla.org/en-US/docs/Games/Techniques/3D_collision_detection
-bool collides_bounding_box(const Transform& transform1, const Transform& transform2)
+bool collides_bounding_box(vec2 position1, vec2 scale1, vec2 position2, vec2 scale2)
 {
 	//diagnal
-	float transform1_scale_diagnal_abs = abs(length(transform1.scale));
-	float transform2_scale_diagnal_abs = abs(length(transform2.scale));
+	float transform1_scale_diagnal_abs = abs(length(scale1));
+	float transform2_scale_diagnal_abs = abs(length(scale2));
 
-	vec2 top_right_1 = { transform1.position.x + transform1_scale_diagnal_abs / 2.f, transform1.position.y + transform1_scale_diagnal_abs / 2.f };
-	vec2 bottom_left_1 = { transform1.position.x - transform1_scale_diagnal_abs / 2.f, transform1.position.y - transform1_scale_diagnal_abs / 2.f };
+	vec2 top_right_1 = { position1.x + transform1_scale_diagnal_abs / 2.f, position1.y + transform1_scale_diagnal_abs / 2.f };
+	vec2 bottom_left_1 = { position1.x - transform1_scale_diagnal_abs / 2.f, position1.y - transform1_scale_diagnal_abs / 2.f };
 
-	vec2 top_right_2 = { transform2.position.x + transform2_scale_diagnal_abs / 2.f, transform2.position.y + transform2_scale_diagnal_abs / 2.f };
-	vec2 bottom_left_2 = { transform2.position.x - transform2_scale_diagnal_abs / 2.f, transform2.position.y - transform2_scale_diagnal_abs / 2.f };
+	vec2 top_right_2 = { position2.x + transform2_scale_diagnal_abs / 2.f, position2.y + transform2_scale_diagnal_abs / 2.f };
+	vec2 bottom_left_2 = { position2.x - transform2_scale_diagnal_abs / 2.f, position2.y - transform2_scale_diagnal_abs / 2.f };
 
 	return bottom_left_1.x <= top_right_2.x 
 		&& top_right_1.x >= bottom_left_2.x
@@ -94,11 +342,39 @@ bool collides_bounding_box(const Transform& transform1, const Transform& transfo
 		&& top_right_1.y >= bottom_left_2.y;
 }
 
-bool collides_with_boundary(const Transform& transform)
+bool collides_bounding_box(const Transform& transform1, const Transform& transform2)
+{
+	return collides_bounding_box(transform1.position, transform1.scale, transform2.position, transform2.scale);
+}
+
+// The same boxes grown to cover the path of the last step, from position - sweep to position
+bool collides_swept_bounding_box(vec2 position1, vec2 scale1, vec2 sweep1, vec2 position2, vec2 scale2, vec2 sweep2)
 {
-	std::vector<CollisionCircle> collision_circles = get_collision_circles(transform);
-	for (CollisionCircle circle : collision_circles) {
-		if (length(circle.position) > MAP_RADIUS - circle.radius) {
+	vec2 half_extent1 = vec2(abs(length(scale1)) / 2.f);
+	vec2 half_extent2 = vec2(abs(length(scale2)) / 2.f);
+	vec2 min1 = min(position1, position1 - sweep1) - half_extent1;
+	vec2 max1 = max(position1, position1 - sweep1) + half_extent1;
+	vec2 min2 = min(position2, position2 - sweep2) - half_extent2;
+	vec2 max2 = max(position2, position2 - sweep2) + half_extent2;
+	return min1.x <= max2.x && max1.x >= min2.x && min1.y <= max2.y && max1.y >= min2.y;
+}
+
+bool collides_with_boundary(const CollisionShape& shape)
+{
+	// The farthest points from the map center are the capsule ends and the box corners
+	if (shape.primitive == COLLIDER_PRIMITIVE::CAPSULE) {
+		return MapGeometry::outside_map(shape.position - shape.axis, shape.radius)
+			|| MapGeometry::outside_map(shape.position + shape.axis, shape.radius);
+	}
+	if (shape.primitive == COLLIDER_PRIMITIVE::BOX) {
+		return MapGeometry::outside_map(shape.position + shape.axis + shape.side, 0.f)
+			|| MapGeometry::outside_map(shape.position + shape.axis - shape.side, 0.f)
+			|| MapGeometry::outside_map(shape.position - shape.axis + shape.side, 0.f)
+			|| MapGeometry::outside_map(shape.position - shape.axis - shape.side, 0.f);
+	}
+	for (unsigned int k = 0; k < shape.count; k++) {
+		const CollisionCircle& circle = shape.circles[k];
+		if (MapGeometry::outside_map(shape.position + circle.position, circle.radius)) {
 			return true;
 		}
 	}
@@ -126,39 +402,24 @@ bool line_interesect_with_circle(vec2 point_1, vec2 point_2, CollisionCircle cir
 }
 
 // Returns the knockback direction if collides. Otherwise returns {0, 0}
-vec2 collides_with_region_boundary(const Transform& transform, const Motion& motion) {
-	float target_angle = atan2f(transform.position.y, transform.position.x);
-	float min_region_angle = 0.f, max_region_angle = 0.f;
-	float region_spread = M_PI * 2 / NUM_REGIONS;
-	for (uint i = 0; i < registry.regions.size(); i++) {
-		min_region_angle = registry.transforms.get(registry.regions.entities[i]).angle;
-		if (min_region_angle > M_PI) min_region_angle -= 2 * M_PI;	// Convert from [0, 2PI] to [-PI, +PI]
-		max_region_angle = min_region_angle + region_spread;
-		if (target_angle > min_region_angle && target_angle < max_region_angle) {
-			break;	// Found the region
-		}
-	}
-	std::vector<CollisionCircle> collision_circles = get_collision_circles(transform);
-	vec2 knockback_dir = {0.f, 0.f};
-	for (CollisionCircle circle : collision_circles) {
-		if (line_interesect_with_circle(vec2(0.f, 0.f), vec2(cosf(min_region_angle) * MAP_RADIUS, 
-										sin(min_region_angle) * MAP_RADIUS), circle)) {
-			vec2 normal_vec = normalize(vec2(cosf(min_region_angle + M_PI / 2), sinf(min_region_angle + M_PI / 2)));
-			if (dot(motion.velocity, normal_vec) < 0) {
-				knockback_dir = motion.velocity - 2 * dot(motion.velocity, normal_vec) * normal_vec;
-				break;
-			}
+// The velocity is reflected off the first edge of the region the shape is in that a circle overlaps and the shape moves out through
+vec2 collides_with_region_boundary(const CollisionShape& shape, const Motion& motion) {
+	unsigned int s = map_geometry.sector_of(shape.position);
+	if (s == MapGeometry::NO_SECTOR) {
+		return { 0.f, 0.f };
+	}
+	const MapGeometry::Sector& sector = map_geometry.sector(s);
+	for (unsigned int k = 0; k < shape.count; k++) {
+		vec2 center = shape.position + shape.circles[k].position;
+		float radius = shape.circles[k].radius;
+		if (MapGeometry::overlaps_edge(sector.start_edge, center, radius) && dot(motion.velocity, sector.start_normal) < 0) {
+			return motion.velocity - 2 * dot(motion.velocity, sector.start_normal) * sector.start_normal;
 		}
-		if (line_interesect_with_circle(vec2(0.f, 0.f), vec2(cos(max_region_angle) * MAP_RADIUS, 
-										sin(max_region_angle) * MAP_RADIUS), circle)) {
-			vec2 normal_vec = normalize(vec2(cos(max_region_angle - M_PI / 2), sin(max_region_angle - M_PI / 2)));
-			if (dot(motion.velocity, normal_vec) < 0) {
-				knockback_dir = motion.velocity - 2 * dot(motion.velocity, normal_vec) * normal_vec;
-				break;
-			}
+		if (MapGeometry::overlaps_edge(sector.end_edge, center, radius) && dot(motion.velocity, sector.end_normal) < 0) {
+			return motion.velocity - 2 * dot(motion.velocity, sector.end_normal) * sector.end_normal;
 		}
 	}
-	return knockback_dir;
+	return { 0.f, 0.f };
 }
 
 // Check which side of line point target is on. The line goes from point_1 to point_2
@@ -206,127 +467,181 @@ bool line_line_intersect(vec2 a, vec2 b, vec2 c, vec2 p1, vec2 p2, vec2 p3) {
 	return false;	
 }
 
+// Maps world positions into the local coordinates of a mesh drawn with `transform`,
+// the inverse of the translate, rotate and scale used to draw it
+struct MeshLocalFrame {
+	vec2 position;
+	vec2 inv_scale;
+	float c, s;
+	MeshLocalFrame(const Transform& transform) :
+		position(transform.position),
+		inv_scale(1.f / transform.scale.x, 1.f / transform.scale.y),
+		c(cosf(transform.angle)),
+		s(sinf(transform.angle))
+	{}
+	vec2 to_local(vec2 p) const {
+		vec2 d = p - position;
+		return vec2(c * d.x + s * d.y, -s * d.x + c * d.y) * inv_scale;
+	}
+};
+
+// Slack on the local bounding boxes of the BVH queries, the vertices are compared in world coordinates
+const float MESH_BVH_QUERY_SLACK = 1e-4f;
+
+// World position of the vertex at `index` in mesh->vertex_indices
+vec2 mesh_world_vertex(const Mesh* mesh, const Transformation& t_matrix, uint16_t index) {
+	const vec3& position = mesh->texture_vertices[mesh->vertex_indices[index]].position;
+	vec3 world_pos = t_matrix.mat * vec3(position.x, position.y, 1.f);
+	return vec2(world_pos.x, world_pos.y);
+}
+
+// Each triangle of mesh2 is mapped into the local coordinates of mesh1 and only tested against
+// the triangles of mesh1 its bounding box overlaps there
 bool collides_mesh_with_mesh(Mesh* mesh1, Transform transform_1, Mesh* mesh2, Transform transform_2) {
+	if (transform_1.scale.x == 0.f || transform_1.scale.y == 0.f) {
+		return false;
+	}
+	assert(!mesh1->bvh.empty() || mesh1->vertex_indices.empty());
 	Transformation t_matrix1;
 	t_matrix1.translate(transform_1.position);
 	t_matrix1.rotate(transform_1.angle);
 	t_matrix1.scale(transform_1.scale);
-	std::vector<vec2> vertex_pos1;
+	MeshLocalFrame frame1(transform_1);
 
 	Transformation t_matrix2;
 	t_matrix2.translate(transform_2.position);
 	t_matrix2.rotate(transform_2.angle);
 	t_matrix2.scale(transform_2.scale);
-	std::vector<vec2> vertex_pos2;
-	
-	// Convert all vertex position to world coordinate
-	for (TexturedVertex v1 : mesh1->texture_vertices) {
-		vec3 world_pos1 = t_matrix1.mat * vec3(v1.position.x, v1.position.y, 1.f);
-		vertex_pos1.push_back(vec2(world_pos1.x, world_pos1.y));
-	}
-
-	for (TexturedVertex v2 : mesh2->texture_vertices) {
-		vec3 world_pos2 = t_matrix2.mat * vec3(v2.position.x, v2.position.y, 1.f);
-		vertex_pos2.push_back(vec2(world_pos2.x, world_pos2.y));
-	}
-
-	for (int i = 0; i < mesh1->vertex_indices.size(); i += 3) {
-		vec2 point1_1 = vertex_pos1[mesh1->vertex_indices[i]];
-		vec2 point1_2 = vertex_pos1[mesh1->vertex_indices[i + 1]];
-		vec2 point1_3 = vertex_pos1[mesh1->vertex_indices[i + 2]];
-		for (int j = 0; j < mesh2->vertex_indices.size(); j += 3) {
-			vec2 point2_1 = vertex_pos2[mesh2->vertex_indices[j]];
-			vec2 point2_2 = vertex_pos2[mesh2->vertex_indices[j + 1]];
-			vec2 point2_3 = vertex_pos2[mesh2->vertex_indices[j + 2]];
+
+	for (uint16_t j = 0; j < mesh2->vertex_indices.size(); j += 3) {
+		vec2 point2_1 = mesh_world_vertex(mesh2, t_matrix2, j);
+		vec2 point2_2 = mesh_world_vertex(mesh2, t_matrix2, j + 1);
+		vec2 point2_3 = mesh_world_vertex(mesh2, t_matrix2, j + 2);
+		vec2 local_1 = frame1.to_local(point2_1);
+		vec2 local_2 = frame1.to_local(point2_2);
+		vec2 local_3 = frame1.to_local(point2_3);
+		vec2 box_min = min(local_1, min(local_2, local_3)) - vec2(MESH_BVH_QUERY_SLACK);
+		vec2 box_max = max(local_1, max(local_2, local_3)) + vec2(MESH_BVH_QUERY_SLACK);
+		bool hit = mesh1->queryBVH(box_min, box_max, [&](uint16_t i) {
+			vec2 point1_1 = mesh_world_vertex(mesh1, t_matrix1, i);
+			vec2 point1_2 = mesh_world_vertex(mesh1, t_matrix1, i + 1);
+			vec2 point1_3 = mesh_world_vertex(mesh1, t_matrix1, i + 2);
 			// line intersection
-			if(line_line_intersect(point1_1, point1_2, point1_3, point2_1, point2_2, point2_3)) return true;
-		}
+			return line_line_intersect(point1_1, point1_2, point1_3, point2_1, point2_2, point2_3);
+		});
+		if (hit) return true;
 	}
 	return false;
 }
 
 // Check if mesh collides with circles. Mesh is associated with transform_1
-bool collides_with_mesh(Mesh *mesh, Transform transform_1, Transform transform_2) {
-	std::vector<CollisionCircle> circles = get_collision_circles(transform_2);
+// The bounding box of each circle is mapped into the local coordinates of the mesh,
+// only the triangles the BVH finds there are tested.
+// With a sweep, the circles moved from their position - sweep relative to the mesh during the step
+// and the whole capsule they swept is tested
+bool collides_with_mesh(Mesh *mesh, Transform transform_1, const CollisionShape& shape_2, vec2 sweep) {
+	if (transform_1.scale.x == 0.f || transform_1.scale.y == 0.f) {
+		return false;
+	}
+	assert(!mesh->bvh.empty() || mesh->vertex_indices.empty());
 	Transformation t_matrix;
 	t_matrix.translate(transform_1.position);
 	t_matrix.rotate(transform_1.angle);
 	t_matrix.scale(transform_1.scale);
-	std::vector<vec2> vertex_pos;
-	// Convert all vertex position to world coordinate
-	for (TexturedVertex v : mesh->texture_vertices) {
-		vec3 world_pos = t_matrix.mat * vec3(v.position.x, v.position.y, 1.f);
-		vertex_pos.push_back(vec2(world_pos.x, world_pos.y));
-	}
-	// For each triangle, check if any of the three edges collides with any of the circles
-	for (int i = 0; i < mesh->vertex_indices.size(); i += 3) {
-		for (CollisionCircle circle : circles) {
-			vec2 point_1 = vertex_pos[mesh->vertex_indices[i]];
-			vec2 point_2 = vertex_pos[mesh->vertex_indices[i+1]];
-			vec2 point_3 = vertex_pos[mesh->vertex_indices[i+2]];
-			if (line_interesect_with_circle(point_1, point_2, circle) ||
+	MeshLocalFrame frame(transform_1);
+	bool swept = sweep.x != 0.f || sweep.y != 0.f;
+
+	for (unsigned int k = 0; k < shape_2.count; k++) {
+		CollisionCircle circle(shape_2.position + shape_2.circles[k].position, shape_2.circles[k].radius);
+		vec2 start = circle.position - sweep;
+		vec2 local = frame.to_local(circle.position);
+		vec2 local_start = frame.to_local(start);
+		vec2 extent = circle.radius * abs(frame.inv_scale) + vec2(MESH_BVH_QUERY_SLACK);
+		// Check if any of the three edges of the triangles collides with the circle
+		bool hit = mesh->queryBVH(min(local, local_start) - extent, max(local, local_start) + extent, [&](uint16_t i) {
+			vec2 point_1 = mesh_world_vertex(mesh, t_matrix, i);
+			vec2 point_2 = mesh_world_vertex(mesh, t_matrix, i + 1);
+			vec2 point_3 = mesh_world_vertex(mesh, t_matrix, i + 2);
+			if (swept) {
+				float radius2 = circle.radius * circle.radius;
+				if (segment_segment_distance2(start, circle.position, point_1, point_2) < radius2 ||
+					segment_segment_distance2(start, circle.position, point_2, point_3) < radius2 ||
+					segment_segment_distance2(start, circle.position, point_3, point_1) < radius2)
+				{
+					return true;
+				}
+			}
+			else if (line_interesect_with_circle(point_1, point_2, circle) ||
 				line_interesect_with_circle(point_2, point_3, circle) || 
 				line_interesect_with_circle(point_3, point_1, circle)) 
 			{
 				return true;
-			} else {
-				// The circle might be completely inside the triangle
-				bool side_1 = get_side_of_line(point_1, point_2, circle.position);
-				bool side_2 = get_side_of_line(point_2, point_3, circle.position);
-				bool side_3 = get_side_of_line(point_3, point_1, circle.position);
-				if (side_1 == side_2 && side_2 == side_3) {
-					return true;
-				}
 			}
-		}
+			// The circle might be completely inside the triangle
+			bool side_1 = get_side_of_line(point_1, point_2, circle.position);
+			bool side_2 = get_side_of_line(point_2, point_3, circle.position);
+			bool side_3 = get_side_of_line(point_3, point_1, circle.position);
+			return side_1 == side_2 && side_2 == side_3;
+		});
+		if (hit) return true;
 	}
 	return false;
 }
 
-// Adds collision events to be handled in world_system's resolve_collisions()
-void collisionhelper(Entity entity_1, Entity entity_2) {
+// The event entity_1 receives when it touches entity_2, by their categories, and the layers each of them needs for it.
+// Pairs without a rule produce no events and are skipped before any shape test.
+// Every rule reports when the contact begins and ends, report_stay ones also every step in between
+struct CollisionRule {
+	COLLISION_CATEGORY category_1, category_2;
+	uint8_t layers_1, layers_2;
+	COLLISION_TYPE type;
+	bool report_stay;
+};
+const CollisionRule COLLISION_RULES[] = {
 	// Bullet Collisions
-	if (registry.projectiles.has(entity_1)) {
-		if (registry.projectiles.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::BULLET_WITH_BULLET, entity_2);
-		}
-		else if (registry.players.has(entity_2) && registry.collidePlayers.has(entity_1)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::BULLET_WITH_PLAYER, entity_2);
-		}
-		else if (registry.enemies.has(entity_2) && registry.collideEnemies.has(entity_1) && registry.collidePlayers.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::BULLET_WITH_ENEMY, entity_2);
-		}
-		else if (registry.cysts.has(entity_2) && registry.collideEnemies.has(entity_1)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::BULLET_WITH_CYST, entity_2);
-		}
+	{ COLLISION_CATEGORY::PROJECTILE, COLLISION_CATEGORY::PROJECTILE, 0, 0, COLLISION_TYPE::BULLET_WITH_BULLET, false },
+	{ COLLISION_CATEGORY::PROJECTILE, COLLISION_CATEGORY::PLAYER, COLLIDE_PLAYERS_LAYER, 0, COLLISION_TYPE::BULLET_WITH_PLAYER, true },	// may hit after the invincibility
+	{ COLLISION_CATEGORY::PROJECTILE, COLLISION_CATEGORY::ENEMY, COLLIDE_ENEMIES_LAYER, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::BULLET_WITH_ENEMY, false },
+	{ COLLISION_CATEGORY::PROJECTILE, COLLISION_CATEGORY::CYST, COLLIDE_ENEMIES_LAYER, 0, COLLISION_TYPE::BULLET_WITH_CYST, false },
 	// Player Collisions
-	} else if (registry.players.has(entity_1) && registry.collidePlayers.has(entity_2)) {
-		if (registry.enemies.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::PLAYER_WITH_ENEMY, entity_2);
-		} else if (registry.cysts.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::PLAYER_WITH_CYST, entity_2);
-		} else if (registry.chests.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::PLAYER_WITH_CHEST, entity_2);
-		} else if (registry.cure.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::PLAYER_WITH_CURE, entity_2);
-		}
+	{ COLLISION_CATEGORY::PLAYER, COLLISION_CATEGORY::ENEMY, 0, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::PLAYER_WITH_ENEMY, true },	// damage after the invincibility
+	{ COLLISION_CATEGORY::PLAYER, COLLISION_CATEGORY::CYST, 0, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::PLAYER_WITH_CYST, true },
+	{ COLLISION_CATEGORY::PLAYER, COLLISION_CATEGORY::CHEST, 0, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::PLAYER_WITH_CHEST, false },
+	{ COLLISION_CATEGORY::PLAYER, COLLISION_CATEGORY::CURE, 0, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::PLAYER_WITH_CURE, false },
 	// Enemy Collisions
-	} else if (registry.enemies.has(entity_1)) {
-		if (registry.enemies.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::ENEMY_WITH_ENEMY, entity_2);
-		}
+	{ COLLISION_CATEGORY::ENEMY, COLLISION_CATEGORY::ENEMY, 0, 0, COLLISION_TYPE::ENEMY_WITH_ENEMY, false },
 	// Sword collisions
-	} else if (registry.attachments.has(entity_1) && registry.attachments.get(entity_1).type == ATTACHMENT_ID::SWORD) {
-		if (registry.enemies.has(entity_2) && registry.collideEnemies.has(entity_1) && registry.collidePlayers.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::SWORD_WITH_ENEMY, entity_2);
-		} else if (registry.cysts.has(entity_2) && registry.collideEnemies.has(entity_1) && registry.collidePlayers.has(entity_2)) {
-			registry.collisions.emplace_with_duplicates(entity_1, COLLISION_TYPE::SWORD_WITH_CYST, entity_2);
+	{ COLLISION_CATEGORY::SWORD, COLLISION_CATEGORY::ENEMY, COLLIDE_ENEMIES_LAYER, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::SWORD_WITH_ENEMY, true },	// hits again after the cooldown
+	{ COLLISION_CATEGORY::SWORD, COLLISION_CATEGORY::CYST, COLLIDE_ENEMIES_LAYER, COLLIDE_PLAYERS_LAYER, COLLISION_TYPE::SWORD_WITH_CYST, true },
+};
+
+// The rule for entity_1 touching entity_2, nullptr if the pair produces no event in that order
+const CollisionRule* collision_rule(const CollisionFilter& filter_1, const CollisionFilter& filter_2)
+{
+	// Rules indexed by the two categories, filled from COLLISION_RULES on first use
+	static const std::array<std::array<const CollisionRule*, collision_category_count>, collision_category_count> table = [] {
+		std::array<std::array<const CollisionRule*, collision_category_count>, collision_category_count> rules{};
+		for (const CollisionRule& rule : COLLISION_RULES) {
+			rules[(int)rule.category_1][(int)rule.category_2] = &rule;
 		}
+		return rules;
+	}();
+	const CollisionRule* rule = table[(int)filter_1.category][(int)filter_2.category];
+	if (rule && (filter_1.layers & rule->layers_1) == rule->layers_1 && (filter_2.layers & rule->layers_2) == rule->layers_2) {
+		return rule;
+	}
+	return nullptr;
+}
+
+// Records the contact, it goes to the contact manager in check_collision once every pair was tested
+void report_collision(std::vector<CollisionEvent>& events, Entity entity_1, const CollisionRule* rule, Entity entity_2) {
+	if (rule) {
+		events.push_back({ entity_1, entity_2, rule->type, rule->report_stay, vec2(0.f) });
 	}
 }
 
 // Calculates angle of the entity based on result of all the forces acting on it
-float get_angle_velocity(Transform& transform, Motion& motion, float elapsed_seconds) {
+float get_angle_velocity(TransformRef transform, MotionRef motion, float elapsed_seconds) {
 	float target_angle = atan2f(motion.force.y, motion.force.x);
 	float angle_remaining = target_angle - transform.angle + transform.angle_offset;
 	if (fabs(angle_remaining) < ANGLE_PRECISION) {
@@ -346,58 +661,62 @@ void step_movement(float elapsed_ms) {
 	// having entities move at different speed based on the machine.
 	float elapsed_seconds = elapsed_ms / 1000.f;	// Since velocities are in units per second
 	auto& motion_container = registry.motions;
-	for (uint i = 0; i < motion_container.size(); i++)
-	{
+	auto& transform_container = registry.transforms;
+	// registry.movables keeps both containers co-sorted, slot i of each belongs to the same entity
+	for (uint i = 0; i < registry.movables.size(); i++) {
 		Entity entity = motion_container.entities[i];
-		assert(registry.transforms.has(entity));
-		Transform& transform = registry.transforms.get(entity);
-		Motion& motion = motion_container.components[i];
+		// Attachments move relative to their parent and are dealt with separately
 		if (registry.attachments.has(entity)) {
-			// will deal with these separately
 			continue;
-		} else {
-			// Update velocity based on forces
-			if (length(motion.force) > 0.f) {
-				motion.velocity += motion.force * elapsed_ms * motion.acceleration_unit;
-
-				// Normalize velocity if not dashing
-				if (!registry.dashes.has(entity) || registry.dashes.get(entity).active_timer_ms <= 0) {
-					float magnitude = length(motion.velocity);
-					if (magnitude > motion.max_velocity) {
-						motion.velocity *= (motion.max_velocity / magnitude);
-					}
+		}
+		MotionRef motion = motion_container.at(i);
+		TransformRef transform = transform_container.at(i);
+
+		// Update velocity based on forces
+		if (length(motion.force) > 0.f) {
+			motion.velocity += motion.force * elapsed_ms * motion.acceleration_unit;
+
+			// Normalize velocity if not dashing
+			Dash* dash = registry.dashes.try_get(entity);
+			if (!dash || dash->active_timer_ms <= 0) {
+				float magnitude = length(motion.velocity);
+				if (magnitude > motion.max_velocity) {
+					motion.velocity *= (motion.max_velocity / magnitude);
 				}
-				motion.angular_velocity = get_angle_velocity(transform, motion, elapsed_seconds);
 			}
+			motion.angular_velocity = get_angle_velocity(transform, motion, elapsed_seconds);
+		}
 
-			// Update transform based on velocities
-			transform.position += motion.velocity * elapsed_seconds;
-			transform.angle += motion.angular_velocity * elapsed_seconds;
-			transform.angle = fmod(transform.angle, 2 * M_PI);
+		// Update transform based on velocities
+		if (SweptCollider* swept = registry.sweptColliders.try_get(entity)) {
+			swept->displacement = motion.velocity * elapsed_seconds;
 		}
+		transform.position += motion.velocity * elapsed_seconds;
+		transform.angle += motion.angular_velocity * elapsed_seconds;
+		transform.angle = fmod(transform.angle, 2 * M_PI);
 
-		if (registry.animations.has(entity) && registry.players.has(entity)) {
+		Animation* animation = registry.animations.try_get(entity);
+		if (animation && registry.players.has(entity)) {
 			bool speed_above_threshold = (abs(length(motion.velocity)) - play_animation_threshold) > 0.0f;
-			Animation& animation = registry.animations.get(entity);
-			if (!speed_above_threshold && animation.total_frame != (int)ANIMATION_FRAME_COUNT::IMMUNITY_BLINKING) {
+			if (!speed_above_threshold && animation->total_frame != (int)ANIMATION_FRAME_COUNT::IMMUNITY_BLINKING) {
 				RenderSystem::animationSys_switchAnimation(entity, ANIMATION_FRAME_COUNT::IMMUNITY_BLINKING, 120);
 			}
-			else if (speed_above_threshold && animation.total_frame != (int)ANIMATION_FRAME_COUNT::IMMUNITY_MOVING && animation.total_frame != (int)ANIMATION_FRAME_COUNT::IMMUNITY_DYING) {
+			else if (speed_above_threshold && animation->total_frame != (int)ANIMATION_FRAME_COUNT::IMMUNITY_MOVING && animation->total_frame != (int)ANIMATION_FRAME_COUNT::IMMUNITY_DYING) {
 				RenderSystem::animationSys_switchAnimation(entity, ANIMATION_FRAME_COUNT::IMMUNITY_MOVING, 30);
 			}
-		}		
+		}
 	}
 }
 
 void PhysicsSystem::update_attachment_orientation(Entity entity, float elapsed_ms) {
 	float elapsed_seconds = elapsed_ms / 1000.f;	// Since velocities are in units per second
 	if (registry.transforms.has(entity) && registry.motions.has(entity)) {
-		Transform& transform = registry.transforms.get(entity);
-		Motion& motion = registry.motions.get(entity);
+		TransformRef transform = registry.transforms.get(entity);
+		MotionRef motion = registry.motions.get(entity);
 		Attachment& attachment = registry.attachments.get(entity);
 		Entity parent = attachment.parent;
-		assert(registry.transforms.has(parent));
-		Transform& parent_transform = registry.transforms.get(parent);
+		assert(registry.valid(parent) && registry.transforms.has(parent));
+		TransformRef parent_transform = registry.transforms.get(parent);
 
 		// 1st part of relative transformation
 		Transformation pos_calculator;
@@ -472,94 +791,313 @@ bool is_outside_screen(vec2 entityPos) {
 	return length(entityPos - camPos) > SCREEN_RADIUS * 1;
 }
 
-// Check collision for all entities with Motion component
-void check_collision() {
+// Narrowphase for a pair whose bounding boxes overlap, reports the collision to both entities
+// rule_ij and rule_ji are the events of the pair in either order, see collision_rule.
+// sweep is how far entity_i moved relative to entity_j in the last step, see SweptCollider
+static void check_pair(std::vector<CollisionEvent>& events, Entity entity_i, const Transform& transform_i, const CollisionShape& shape_i,
+	Entity entity_j, const Transform& transform_j, const CollisionShape& shape_j,
+	const CollisionRule* rule_ij, const CollisionRule* rule_ji, vec2 sweep)
+{
+	// ignore collision between an attachment (ie. dashing, sword) and its owner
+	if ((registry.attachments.has(entity_i) && registry.attachments.get(entity_i).parent == entity_j)
+		|| (registry.attachments.has(entity_j) && registry.attachments.get(entity_j).parent == entity_i)) {
+		return;
+	}
+
+
+	if (registry.meshPtrs.has(entity_i) && registry.meshPtrs.has(entity_j)) {//mesh-mesh collision
+		if ( collides_mesh_with_mesh(registry.meshPtrs.get(entity_i), transform_i, registry.meshPtrs.get(entity_j), transform_j) ) {
+			report_collision(events, entity_i, rule_ij, entity_j);
+			report_collision(events, entity_j, rule_ji, entity_i);
+		}
+	} else if (registry.meshPtrs.has(entity_i)) {
+		if (collides_with_mesh(registry.meshPtrs.get(entity_i), transform_i, shape_j, -sweep)) {
+			report_collision(events, entity_i, rule_ij, entity_j);
+			report_collision(events, entity_j, rule_ji, entity_i);
+		}
+	} else if (registry.meshPtrs.has(entity_j)) {
+		if (collides_with_mesh(registry.meshPtrs.get(entity_j), transform_j, shape_i, sweep)) {
+			report_collision(events, entity_i, rule_ij, entity_j);
+			report_collision(events, entity_j, rule_ji, entity_i);
+		}
+	} else {
+		bool swept = sweep.x != 0.f || sweep.y != 0.f;
+		if (swept ? sweeps_collide(shape_i, shape_j, sweep) : collides(shape_i, shape_j))
+		{
+			// Create a collisions event
+			// We are abusing the ECS system a bit in that we potentially insert muliple collisions for the same entity
+			// If collision between player and enemy, always add the collision component under player entity
+			report_collision(events, entity_i, rule_ij, entity_j);
+			report_collision(events, entity_j, rule_ji, entity_i);
+		}
+	}
+}
+
+// CIRCLES unless the entity has a ColliderShape
+static COLLIDER_PRIMITIVE collider_primitive(Entity entity)
+{
+	unsigned int slot = registry.colliderShapes.find(entity);
+	return slot == registry.colliderShapes.INVALID_SLOT ? COLLIDER_PRIMITIVE::CIRCLES : registry.colliderShapes.components[slot].primitive;
+}
+
+// Collision filter of an entity, COLLISION_CATEGORY::NONE if it has none
+static CollisionFilter collision_filter(Entity entity)
+{
+	unsigned int slot = registry.collisionFilters.find(entity);
+	return slot == registry.collisionFilters.INVALID_SLOT ? CollisionFilter() : registry.collisionFilters.components[slot];
+}
+
+// Static colliders only change when one is created or destroyed, the index is rebuilt then and reused otherwise
+void PhysicsSystem::update_static_index() {
+	auto& static_container = registry.staticColliders;
+	if (static_container.version() == static_index_version) {
+		// The colliders do not move, but their transforms can still be written, e.g. squish() rescales the cysts.
+		// The shapes are only recomputed for the ones that changed, the grid only if one moved or outgrew its cells
+		bool outgrown = false;
+		for (unsigned int s = 0; s < static_entities.size() && !outgrown; s++) {
+			Transform transform = registry.transforms.get(static_entities[s]);
+			outgrown = transform.position != static_transforms[s].position || abs(length(transform.scale)) / 2.f > static_extents[s];
+			static_transforms[s] = transform;
+			static_shapes.update(s, transform, collider_primitive(static_entities[s]));
+		}
+		if (!outgrown)
+			return;
+	}
+	static_index_version = static_container.version();
+
+	static_entities.clear();
+	static_transforms.clear();
+	static_extents.clear();
+	static_filters.clear();
+	static_grid.clear();
+	for (Entity entity : static_container.entities) {
+		assert(registry.transforms.has(entity) && "Static colliders need a Transform");
+		Transform transform = registry.transforms.get(entity);
+		float half_extent = abs(length(transform.scale)) / 2.f;
+		static_grid.insert((unsigned int)static_entities.size(), transform.position - half_extent, transform.position + half_extent);
+		static_entities.push_back(entity);
+		static_transforms.push_back(transform);
+		static_extents.push_back(half_extent);
+		static_filters.push_back(collision_filter(entity));
+	}
+	static_grid.build();
+	static_shapes.resize((unsigned int)static_entities.size());
+	for (unsigned int s = 0; s < static_transforms.size(); s++)
+		static_shapes.update(s, static_transforms[s], collider_primitive(static_entities[s]));
+}
+
+// Check collision for all entities with Motion component, and between them and the static colliders
+void PhysicsSystem::check_collision() {
 	auto& motion_container = registry.motions;
-	// Check for collisions between all moving entities
-	for (uint i = 0; i < motion_container.components.size(); i++)
+	auto& transform_container = registry.transforms;
+
+	// Every moving entity has a transform and registry.movables keeps both containers co-sorted, so slot i
+	// of motions and transforms is the same entity. The broadphase reads positions and scales straight from
+	// the Transform field arrays, a full Transform is only assembled for pairs whose bounding boxes overlap
+	assert(registry.movables.size() == motion_container.size());
+	const vec2* positions = transform_container.field(&Transform::position);
+	const vec2* scales = transform_container.field(&Transform::scale);
+
+	// Collision circles of every moving entity, only recomputed for the ones that were scaled or rotated,
+	// and their collision filters and last step displacements in slot order
+	movable_shapes.resize((unsigned int)motion_container.size());
+	movable_filters.resize(motion_container.size());
+	movable_sweeps.resize(motion_container.size());
+	for (uint i = 0; i < motion_container.size(); i++) {
+		Entity entity = motion_container.entities[i];
+		movable_shapes.update(i, transform_container.at(i), collider_primitive(entity));
+		movable_filters[i] = collision_filter(entity);
+		unsigned int swept_slot = registry.sweptColliders.find(entity);
+		movable_sweeps[i] = swept_slot == registry.sweptColliders.INVALID_SLOT ? vec2(0.f) : registry.sweptColliders.components[swept_slot].displacement;
+	}
+
+	// Broadphase: on-screen entities go into the grid with the box collides_swept_bounding_box tests,
+	// so every pair whose boxes overlap shares a cell. The pairs come out sorted by (i, j)
+	collision_grid.clear();
+	for (uint i = 0; i < motion_container.size(); i++) {
+		if (is_outside_screen(positions[i])) {
+			continue;
+		}
+		vec2 half_extent = vec2(abs(length(scales[i])) / 2.f);
+		vec2 start = positions[i] - movable_sweeps[i];
+		collision_grid.insert(i, min(positions[i], start) - half_extent, max(positions[i], start) + half_extent);
+	}
+	collision_grid.build();
+	collision_grid.collect_pairs(candidate_pairs);
+
+	update_static_index();
+
+	// Narrowphase in tasks of consecutive slots, each records its events in its own buffer
+	unsigned int task_count = ((unsigned int)motion_container.size() + COLLISION_SLOTS_PER_TASK - 1) / COLLISION_SLOTS_PER_TASK;
+	if (collision_tasks.size() < task_count) {
+		collision_tasks.resize(task_count);
+	}
+	collision_workers.run(task_count, [this](unsigned int t) {
+		unsigned int begin = t * COLLISION_SLOTS_PER_TASK;
+		unsigned int end = std::min(begin + COLLISION_SLOTS_PER_TASK, (unsigned int)registry.motions.size());
+		check_slots(begin, end, collision_tasks[t]);
+	});
+
+	// Boundary collisions are reported directly, touching pairs go through the contact manager.
+	// The tasks cover the slots in order, so this is the order one thread checking every slot finds them in
+	contacts.begin_step();
+	for (unsigned int t = 0; t < task_count; t++) {
+		for (const CollisionEvent& event : collision_tasks[t].events) {
+			if (event.entity_2 != Entity::null()) {
+				contacts.touch(event.entity_1, event.entity_2, event.type, event.report_stay);
+			}
+			else if (event.type == COLLISION_TYPE::PLAYER_WITH_REGION_BOUNDARY) {
+				registry.collisions.emplace_with_duplicates(event.entity_1, event.type, event.knockback_dir);
+			}
+			else {
+				registry.collisions.emplace_with_duplicates(event.entity_1, event.type);
+			}
+		}
+	}
+	contacts.end_step();
+
+	// Events for resolve_collisions: contacts that begin or end, and the ones that stay if their rule wants them.
+	// A contact ends when either entity is gone as well, those are not reported
+	for (const ContactManager::Contact& contact : contacts.get_contacts()) {
+		if (contact.state == CONTACT_STATE::STAY && !contact.report_stay) {
+			continue;
+		}
+		if (contact.state == CONTACT_STATE::END && (!Entity::alive(contact.entity_1) || !Entity::alive(contact.entity_2))) {
+			continue;
+		}
+		Entity other = contact.entity_2;
+		registry.collisions.emplace_with_duplicates(contact.entity_1, contact.type, other).state = contact.state;
+	}
+}
+
+// Narrowphase of the moving entities in slots [begin, end) against the boundaries, the other moving entities
+// and the static colliders. Only reads the registry and the buffers check_collision prepared, so tasks can run
+// in parallel
+void PhysicsSystem::check_slots(unsigned int begin, unsigned int end, CollisionTask& task) const {
+	auto& motion_container = registry.motions;
+	auto& transform_container = registry.transforms;
+	const vec2* positions = transform_container.field(&Transform::position);
+	const vec2* scales = transform_container.field(&Transform::scale);
+	std::vector<CollisionEvent>& events = task.events;
+	std::vector<unsigned int>& static_candidates = task.static_candidates;
+	events.clear();
+
+	// the candidate pairs are sorted by their first slot
+	size_t next_pair = std::lower_bound(candidate_pairs.begin(), candidate_pairs.end(), std::make_pair(begin, 0u)) - candidate_pairs.begin();
+
+	for (uint i = begin; i < end; i++)
 	{
 		Entity entity_i = motion_container.entities[i];
-		assert(registry.transforms.has(entity_i));
-		Transform transform_i = registry.transforms.get(entity_i);
+		Transform transform_i = transform_container.at(i);
+		CollisionShape shape_i = movable_shapes.shape(i, transform_i.position);
 
 		// Check for collisions with the map boundary
-		if (!registry.cysts.has(entity_i) && collides_with_boundary(transform_i)) {
-			if (registry.projectiles.has(entity_i)) {
-				registry.collisions.emplace_with_duplicates(entity_i, COLLISION_TYPE::BULLET_WITH_BOUNDARY);
+		if (collides_with_boundary(shape_i)) {
+			if (movable_filters[i].category == COLLISION_CATEGORY::PROJECTILE) {
+				events.push_back({ entity_i, Entity::null(), COLLISION_TYPE::BULLET_WITH_BOUNDARY, false, vec2(0.f) });
 			}
 			else {
-				registry.collisions.emplace_with_duplicates(entity_i, COLLISION_TYPE::WITH_BOUNDARY);
+				events.push_back({ entity_i, Entity::null(), COLLISION_TYPE::WITH_BOUNDARY, false, vec2(0.f) });
 			}
 		}
 
 		// Check for collisions with the region boundary in boss fight
 		if (registry.players.has(entity_i) && registry.bosses.size() > 0 && registry.bosses.components.front().activated) {
-			vec2 knockback_dir = collides_with_region_boundary(transform_i, motion_container.components[i]);
+			vec2 knockback_dir = collides_with_region_boundary(shape_i, motion_container.at(i));
 			if (knockback_dir.x != 0.f && knockback_dir.y != 0.f) {
-				registry.collisions.emplace_with_duplicates(entity_i, COLLISION_TYPE::PLAYER_WITH_REGION_BOUNDARY, knockback_dir);
+				events.push_back({ entity_i, Entity::null(), COLLISION_TYPE::PLAYER_WITH_REGION_BOUNDARY, false, knockback_dir });
 			} 
 		}
 
-		// skip if outside screen after checking boundary
-		if (is_outside_screen(transform_i.position)) {
-			continue;
-		}
-
-		// note starting j at i+1 to compare all (i,j) pairs only once (and to not compare with itself)
-		for (uint j = i + 1; j < motion_container.components.size(); j++)
+		// entities outside the screen are not in the grid and have no candidate pairs
+		// walking the candidates of i in order of j reports collisions in the same order as comparing all (i,j) pairs
+		for (; next_pair < candidate_pairs.size() && candidate_pairs[next_pair].first == i; next_pair++)
 		{
-			Entity entity_j = motion_container.entities[j];
-			assert(registry.transforms.has(entity_j));
-			Transform transform_j = registry.transforms.get(entity_j);
+			uint j = candidate_pairs[next_pair].second;
 
-			// skip if outside screen
-			if (is_outside_screen(transform_j.position)) {
+			// skip pairs that cannot produce an event
+			const CollisionRule* rule_ij = collision_rule(movable_filters[i], movable_filters[j]);
+			const CollisionRule* rule_ji = collision_rule(movable_filters[j], movable_filters[i]);
+			if (!rule_ij && !rule_ji) {
 				continue;
 			}
 
 			//skip if bounding box is not colliding
-			if (!collides_bounding_box(transform_i, transform_j)) {
+			if (!collides_swept_bounding_box(positions[i], scales[i], movable_sweeps[i], positions[j], scales[j], movable_sweeps[j])) {
 				continue;
 			}
+			Transform transform_j = transform_container.at(j);
+			check_pair(events, entity_i, transform_i, shape_i, motion_container.entities[j], transform_j, movable_shapes.shape(j, transform_j.position),
+				rule_ij, rule_ji, movable_sweeps[i] - movable_sweeps[j]);
+		}
 
-			// ignore collision between an attachment (ie. dashing, sword) and its owner
-			if ((registry.attachments.has(entity_i) && registry.attachments.get(entity_i).parent == entity_j)
-				|| (registry.attachments.has(entity_j) && registry.attachments.get(entity_j).parent == entity_i)) {
+		// Static colliders are only tested against the moving entities around them
+		if (is_outside_screen(positions[i])) {
+			continue;
+		}
+		vec2 half_extent = vec2(abs(length(scales[i])) / 2.f);
+		vec2 start = positions[i] - movable_sweeps[i];
+		static_candidates.clear();
+		static_grid.query(min(positions[i], start) - half_extent, max(positions[i], start) + half_extent,
+			[&static_candidates](unsigned int s) { static_candidates.push_back(s); });
+		std::sort(static_candidates.begin(), static_candidates.end());
+		static_candidates.erase(std::unique(static_candidates.begin(), static_candidates.end()), static_candidates.end());
+		for (unsigned int s : static_candidates) {
+			const CollisionRule* rule_is = collision_rule(movable_filters[i], static_filters[s]);
+			const CollisionRule* rule_si = collision_rule(static_filters[s], movable_filters[i]);
+			if (!rule_is && !rule_si) {
 				continue;
 			}
-
-
-			if (registry.meshPtrs.has(entity_i) && registry.meshPtrs.has(entity_j)) {//mesh-mesh collision
-				if ( collides_mesh_with_mesh(registry.meshPtrs.get(entity_i), transform_i, registry.meshPtrs.get(entity_j), transform_j) ) {
-					collisionhelper(entity_i, entity_j);
-					collisionhelper(entity_j, entity_i);
-				}
-			} else if (registry.meshPtrs.has(entity_i)) {
-				if (collides_with_mesh(registry.meshPtrs.get(entity_i), transform_i, transform_j)) {
-					collisionhelper(entity_i, entity_j);
-					collisionhelper(entity_j, entity_i);
-				}
-			} else if (registry.meshPtrs.has(entity_j)) {
-				if (collides_with_mesh(registry.meshPtrs.get(entity_j), transform_j, transform_i)) {
-					collisionhelper(entity_i, entity_j);
-					collisionhelper(entity_j, entity_i);
-				}
-			} else {
-				if (collides(transform_i, transform_j))
-				{
-					// Create a collisions event
-					// We are abusing the ECS system a bit in that we potentially insert muliple collisions for the same entity
-					// If collision between player and enemy, always add the collision component under player entity
-					collisionhelper(entity_i, entity_j);
-					collisionhelper(entity_j, entity_i);
-				}
+			const Transform& transform_s = static_transforms[s];
+			if (is_outside_screen(transform_s.position)
+				|| !collides_swept_bounding_box(positions[i], scales[i], movable_sweeps[i], transform_s.position, transform_s.scale, vec2(0.f))) {
+				continue;
 			}
+			check_pair(events, entity_i, transform_i, shape_i, static_entities[s], transform_s, static_shapes.shape(s, transform_s.position),
+				rule_is, rule_si, movable_sweeps[i]);
 		}
 	}
 }
 
+// Interleave the bits of the two 16 bit cell coordinates
+uint32_t morton_code(vec2 position)
+{
+	auto spread = [](float coordinate) {
+		float cell = (coordinate + MAP_RADIUS) * (1.f / SPATIAL_REORDER_CELL_SIZE);
+		uint32_t bits = cell <= 0.f ? 0u : (cell >= 65535.f ? 65535u : (uint32_t)cell);
+		bits = (bits | (bits << 8)) & 0x00FF00FF;
+		bits = (bits | (bits << 4)) & 0x0F0F0F0F;
+		bits = (bits | (bits << 2)) & 0x33333333;
+		bits = (bits | (bits << 1)) & 0x55555555;
+		return bits;
+	};
+	return spread(position.x) | (spread(position.y) << 1);
+}
+
+void PhysicsSystem::reorder_spatially()
+{
+	if (reorder_budget == 0)
+		return;
+
+	// Transforms and motions move together through their group
+	const vec2* positions = registry.transforms.field(&Transform::position);
+	movables_order.step(registry.movables.size(), reorder_budget,
+		[positions](unsigned int i) { return morton_code(positions[i]); },
+		[](unsigned int a, unsigned int b) { registry.movables.swap_slots(a, b); });
+
+	auto& enemy_container = registry.enemies;
+	auto& transform_container = registry.transforms;
+	enemies_order.step((unsigned int)enemy_container.size(), reorder_budget,
+		[&](unsigned int i) {
+			unsigned int slot = transform_container.find(enemy_container.entities[i]);
+			return slot == transform_container.INVALID_SLOT ? UINT32_MAX : morton_code(positions[slot]);
+		},
+		[&](unsigned int a, unsigned int b) { enemy_container.swap_slots(a, b); });
+}
+
 void PhysicsSystem::step(float elapsed_ms)
 {
+	reorder_spatially();
 	step_movement(elapsed_ms);
 	step_attachment_movement(elapsed_ms);	// Should handle these after setting all the positions
 	check_collision();
@@ -4,6 +4,127 @@
 #include "tiny_ecs.hpp"
 #include "components.hpp"
 #include "tiny_ecs_registry.hpp"
+#include "spatial_grid.hpp"
+#include "contact_manager.hpp"
+#include "worker_pool.hpp"
+
+// Moving entities and enemies are kept roughly in Morton (Z-order) order of their position, so entities that
+// are close in the world are close in memory for collision checks and AI queries.
+// At most this many slot swaps are spent on it per step.
+const unsigned int SPATIAL_REORDER_BUDGET = 256;
+// Positions are quantized to cells of this size before computing the Morton code
+const float SPATIAL_REORDER_CELL_SIZE = 64.f;
+// Cell size of the collision broadphase grid, around the size of the common enemies
+const float COLLISION_CELL_SIZE = 128.f;
+
+// The collision narrowphase is split into tasks of this many consecutive moving entities,
+// run on up to COLLISION_MAX_THREADS threads including the main thread
+const unsigned int COLLISION_SLOTS_PER_TASK = 64;
+const unsigned int COLLISION_MAX_THREADS = 4;
+
+// Z-order curve index of a world position
+uint32_t morton_code(vec2 position);
+
+// Insertion sort of slots by key that does at most `budget` swaps per step and resumes where it stopped.
+// Keys are recomputed every step into a reused buffer, so steady-state steps do not allocate.
+class IncrementalSort
+{
+	std::vector<uint32_t> keys;
+	unsigned int cursor = 1;
+public:
+	// key(i) is the key of slot i and swap(a, b) exchanges two slots. Returns the number of swaps done
+	template <typename Key, typename Swap>
+	unsigned int step(unsigned int count, unsigned int budget, Key key, Swap swap) {
+		keys.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+			keys[i] = key(i);
+		if (cursor >= count)
+			cursor = 1;
+
+		unsigned int swaps = 0;
+		while (cursor < count) {
+			unsigned int j = cursor;
+			while (j > 0 && keys[j] < keys[j - 1]) {
+				if (swaps == budget)
+					return swaps;	// continue with this element next step
+				std::swap(keys[j], keys[j - 1]);
+				swap(j - 1, j);
+				swaps++;
+				j--;
+			}
+			cursor++;
+		}
+		return swaps;
+	}
+};
+
+// One of the circles approximating the collision region of an entity, see get_collision_circles
+struct CollisionCircle {
+	vec2 position;
+	float radius;
+	CollisionCircle(vec2 position, float radius) : 
+		position(position), 
+		radius(radius) 
+	{}
+};
+
+// The collision region of an entity. The circles are always present, their positions are offsets
+// from `position`. Pairs of entities are tested with the primitive:
+// CAPSULE: segment from position - axis to position + axis, rounded by radius
+// BOX: centered at position, axis and side are its half extents along the two edges
+struct CollisionShape {
+	vec2 position;
+	const CollisionCircle* circles;
+	unsigned int count;
+	COLLIDER_PRIMITIVE primitive;
+	vec2 axis;
+	vec2 side;
+	float radius;
+};
+
+// A collision found by a collision task. Tasks only record them, check_collision applies them
+// in slot order once all tasks finished, so the events do not depend on the number of threads
+struct CollisionEvent {
+	Entity entity_1 = Entity::null();
+	Entity entity_2 = Entity::null();	// null for the map and region boundaries
+	COLLISION_TYPE type;
+	bool report_stay;
+	vec2 knockback_dir;
+};
+
+// Collision circles of the entities in a container, indexed by slot and stored in one flat buffer.
+// The circle offsets only depend on scale and angle, so they are recomputed when those changed
+// since the slot was last used and moving does not invalidate them. Steady-state steps do not allocate.
+class CollisionShapeCache
+{
+	struct Entry {
+		vec2 scale;
+		float angle;
+		COLLIDER_PRIMITIVE primitive;
+		unsigned int offset, count, capacity;
+		bool valid;
+		vec2 axis, side;
+		float radius;
+	};
+	std::vector<Entry> entries;
+	std::vector<CollisionCircle> circles;
+	std::vector<CollisionCircle> generated, compacted;
+	size_t live = 0;	// circles in use, the rest of the buffer is left by shapes that grew
+
+	void compact();
+public:
+	// Make room for slots [0, count), call before update() whenever the container grew
+	void resize(unsigned int count);
+	// Recompute the shape of `slot` if its primitive or the scale or angle of its transform changed.
+	// May move the buffer, update every slot needed before taking shapes
+	void update(unsigned int slot, const Transform& transform, COLLIDER_PRIMITIVE primitive);
+	// The shape of `slot` placed at `position`, valid until the next update()
+	CollisionShape shape(unsigned int slot, vec2 position) const {
+		const Entry& entry = entries[slot];
+		assert(entry.valid);
+		return { position, circles.data() + entry.offset, entry.count, entry.primitive, entry.axis, entry.side, entry.radius };
+	}
+};
 
 // A simple physics system that moves rigid bodies and checks for collision
 class PhysicsSystem
@@ -11,8 +132,57 @@ class PhysicsSystem
 public:
 	void step(float elapsed_ms);
 	static void update_attachment_orientation(Entity entity, float elapsed_ms);
+	// Forget the touching pairs without reporting their end, when the world is reset
+	void clear_contacts() { contacts.clear(); }
 
-	PhysicsSystem()
+	// Slot swaps per step spent on spatial reordering, 0 disables it
+	unsigned int reorder_budget = SPATIAL_REORDER_BUDGET;
+
+	PhysicsSystem() :
+		PhysicsSystem(std::max(1u, std::min(COLLISION_MAX_THREADS, std::thread::hardware_concurrency())))
 	{
 	}
+	explicit PhysicsSystem(unsigned int collision_threads) :
+		collision_workers(collision_threads)
+	{
+	}
+
+private:
+	// Buffers of one collision task, kept to reuse them across steps
+	struct CollisionTask {
+		std::vector<CollisionEvent> events;
+		std::vector<unsigned int> static_candidates;
+	};
+
+	void reorder_spatially();
+	void check_collision();
+	void check_slots(unsigned int begin, unsigned int end, CollisionTask& task) const;
+	void update_static_index();
+
+	// Broadphase of check_collision, kept to reuse the buffers across steps
+	SpatialHashGrid collision_grid{ COLLISION_CELL_SIZE };
+	std::vector<std::pair<unsigned int, unsigned int>> candidate_pairs;
+
+	// Index of the static colliders, rebuilt only when one is created or destroyed, or was moved or grown
+	SpatialHashGrid static_grid{ COLLISION_CELL_SIZE };
+	std::vector<Entity> static_entities;
+	std::vector<Transform> static_transforms;	// copied from the live transforms every step
+	std::vector<float> static_extents;	// half extent each collider was inserted in the grid with
+	std::vector<CollisionFilter> static_filters;
+	unsigned int static_index_version = 0;
+
+	// Collision circles of the moving entities and of the static colliders
+	CollisionShapeCache movable_shapes;
+	CollisionShapeCache static_shapes;
+	std::vector<CollisionFilter> movable_filters;
+	std::vector<vec2> movable_sweeps;	// SweptCollider displacement, 0 for the others
+
+	// Pairs touching across steps, turned into begin/stay/end events
+	ContactManager contacts;
+
+	WorkerPool collision_workers;
+	std::vector<CollisionTask> collision_tasks;
+
+	IncrementalSort movables_order;
+	IncrementalSort enemies_order;
 };
\ No newline at end of file
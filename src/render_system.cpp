@@ -237,9 +237,35 @@ bool RenderSystem::is_outside_screen(vec2 entityPos) {
 	return length(entityPos - camPos) > SCREEN_RADIUS * 1.2;
 }
 
+void RenderSystem::save_previous_transforms()
+{
+	auto& transform_container = registry.transforms;
+	const vec2* positions = transform_container.field(&Transform::position);
+	const float* angles = transform_container.field(&Transform::angle);
+	for (unsigned int i = 0; i < transform_container.size(); i++) {
+		Entity entity = transform_container.entities[i];
+		if (entity.index() >= previous_transforms.size()) {
+			previous_transforms.resize(std::max((size_t)entity.index() + 1, previous_transforms.size() * 2));
+		}
+		previous_transforms[entity.index()] = { entity, positions[i], angles[i] };
+	}
+
+	previous_camera = Entity::null();
+	if (registry.camera.size() == 1) {
+		previous_camera = registry.camera.entities[0];
+		previous_camera_position = registry.camera.components[0].position;
+	}
+}
+
+void RenderSystem::reset_interpolation()
+{
+	previous_transforms.clear();
+	previous_camera = Entity::null();
+}
+
 // Render our game world
 // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
-void RenderSystem::draw()
+void RenderSystem::draw(float alpha)
 {
 	// Getting size of window
 	int w, h;
@@ -262,6 +288,11 @@ void RenderSystem::draw()
 	gl_has_errors();
 	mat3 projection_2D = createProjectionMatrix();
 	mat3 view = createViewMatrix();
+	if (registry.camera.size() == 1 && registry.camera.entities[0] == previous_camera) {
+		Transformation interpolated_view;
+		interpolated_view.translate(-mix(previous_camera_position, registry.camera.components[0].position, alpha));
+		view = interpolated_view.mat;
+	}
 	mat3 viewProjection = projection_2D * view;
 
 	// update player entity (it might change on death)
@@ -270,40 +301,44 @@ void RenderSystem::draw()
 		player = players.back();
 	}
 
-	// Draw entities based on their renderRequest order
-	/*
-	 * Payam: This code is O(4N) instead of original O(N) but uses good cache locality.
-	 * I could not think of a more efficient way to render entities in order.
-	 */
-	for (uint order = 0; order < render_order_count; order++) {
-		for (uint i = 0; i < registry.renderRequests.components.size(); i++) {
-			if ((uint)registry.renderRequests.components[i].order == order) {
-				Entity entity = registry.renderRequests.entities[i];
-				RenderRequest& render_request = registry.renderRequests.components[i];
-				if (registry.transforms.has(entity)) {
-					Transform& transform = registry.transforms.get(entity);
-
-					// View frustum culling; ie. cull entities before vertex shader
-					// exclude on-screen entities, regions, and UI elements from culling
-					if (!registry.regions.has(entity) && !transform.is_screen_coord && is_outside_screen(transform.position)) {
-						continue;
-					}
-
-					// Transformation
-					Transformation transformation;
-					transformation.translate(transform.position);
-					transformation.rotate(transform.angle);
-					transformation.scale(transform.scale);
-					// Note, its not very efficient to access elements indirectly via the entity
-					// albeit iterating through all Sprites in sequence. A good point to optimize
-
-					if (transform.is_screen_coord) {
-						drawEntity(entity, render_request, transformation.mat, projection_2D);
-					}
-					else {
-						drawEntity(entity, render_request, transformation.mat, viewProjection);
-					}
-				}
+	// Bucket entities by their renderRequest order in one pass, then draw the buckets in order
+	for (auto& bucket : draw_buckets)
+		bucket.clear();
+	registry.view<RenderRequest, Transform>().each_in_order_of<RenderRequest>([&](Entity entity, RenderRequest& render_request, TransformRef transform) {
+		// View frustum culling; ie. cull entities before vertex shader
+		// exclude on-screen entities, regions, and UI elements from culling
+		if (!registry.regions.has(entity) && !transform.is_screen_coord && is_outside_screen(transform.position)) {
+			return;
+		}
+		draw_buckets[(uint)render_request.order].push_back({ entity, &render_request, transform });
+
+		// World entities are drawn between their previous and current state, UI elements where they are
+		Transform& drawn = draw_buckets[(uint)render_request.order].back().transform;
+		if (!drawn.is_screen_coord && entity.index() < previous_transforms.size()
+			&& previous_transforms[entity.index()].entity == entity) {
+			const PreviousTransform& previous = previous_transforms[entity.index()];
+			// turn the short way around
+			float angle_delta = remainderf(drawn.angle - previous.angle, 2.f * M_PI);
+			drawn.position = mix(previous.position, drawn.position, alpha);
+			drawn.angle = drawn.angle - (1.f - alpha) * angle_delta;
+		}
+	});
+
+	for (auto& bucket : draw_buckets) {
+		for (DrawItem& item : bucket) {
+			const Transform& transform = item.transform;
+
+			// Transformation
+			Transformation transformation;
+			transformation.translate(transform.position);
+			transformation.rotate(transform.angle);
+			transformation.scale(transform.scale);
+
+			if (transform.is_screen_coord) {
+				drawEntity(item.entity, *item.render_request, transformation.mat, projection_2D);
+			}
+			else {
+				drawEntity(item.entity, *item.render_request, transformation.mat, viewProjection);
 			}
 		}
 	}
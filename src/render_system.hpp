@@ -163,8 +163,14 @@ public:
 	// Destroy resources associated to one or all entities created by the system
 	~RenderSystem();
 
-	// Draw all entities
-	void draw();
+	// Draw all entities, alpha in [0, 1] is how far the frame is between the saved previous
+	// simulation state and the current one
+	void draw(float alpha = 1.f);
+
+	// Keep the current positions and angles as the previous simulation state, call before each tick
+	void save_previous_transforms();
+	// Forget the previous simulation state, the next frame is drawn as the world is, e.g. after a restart
+	void reset_interpolation();
 
 	mat3 createProjectionMatrix();
 
@@ -213,7 +219,26 @@ private:
 	GLuint off_screen_render_buffer_depth;
 
 	Entity screen_state_entity;
-	
+
+	// Per-frame draw list, one bucket per RENDER_ORDER. Kept as members to reuse their capacity
+	struct DrawItem {
+		Entity entity;
+		const RenderRequest* render_request;
+		Transform transform;
+	};
+	std::array<std::vector<DrawItem>, render_order_count> draw_buckets;
+
+	// Simulation state before the last tick, indexed by Entity::index(). The stored entity tells whether the
+	// slot is still about the same entity, the ones created during the tick are drawn where they are
+	struct PreviousTransform {
+		Entity entity = Entity::null();
+		vec2 position;
+		float angle;
+	};
+	std::vector<PreviousTransform> previous_transforms;
+	// Camera position before the last tick, and the camera entity it belongs to
+	vec2 previous_camera_position;
+	Entity previous_camera = Entity::null();
 };
 
 
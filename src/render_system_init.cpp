@@ -153,6 +153,12 @@ void RenderSystem::initializeGlMeshes()
 			meshes[(int)geom_index].color_vertices, 
 			meshes[(int)geom_index].vertex_indices);
 	}
+
+	// The loaded meshes double as colliders, see collides_with_mesh
+	for (auto& path : mesh_paths)
+		meshes[(int)path.first].buildBVH();
+	for (auto& path : mesh_paths_color_vector)
+		meshes[(int)path.first].buildBVH();
 }
 
 void RenderSystem::initializeGlGeometryBuffers()
@@ -0,0 +1,102 @@
+// internal
+#include "spatial_grid.hpp"
+
+#include <algorithm>
+
+SpatialHashGrid::SpatialHashGrid(float cell_size)
+	: cell_size(cell_size)
+{
+}
+
+void SpatialHashGrid::clear()
+{
+	entries.clear();
+	entry_cells.clear();
+	max_item = 0;
+	sorted_items.clear();
+	bucket_start.clear();
+}
+
+void SpatialHashGrid::cell_range(vec2 box_min, vec2 box_max, int& min_x, int& min_y, int& max_x, int& max_y) const
+{
+	min_x = (int)floorf(box_min.x / cell_size);
+	min_y = (int)floorf(box_min.y / cell_size);
+	max_x = (int)floorf(box_max.x / cell_size);
+	max_y = (int)floorf(box_max.y / cell_size);
+}
+
+void SpatialHashGrid::insert(unsigned int item, vec2 box_min, vec2 box_max)
+{
+	max_item = std::max(max_item, item);
+	int min_x, min_y, max_x, max_y;
+	cell_range(box_min, box_max, min_x, min_y, max_x, max_y);
+	for (int y = min_y; y <= max_y; y++)
+		for (int x = min_x; x <= max_x; x++) {
+			entries.push_back({ 0, item });
+			entry_cells.push_back({ x, y });
+		}
+}
+
+void SpatialHashGrid::build()
+{
+	// About two buckets per entry keeps unrelated cells from sharing a bucket
+	bucket_count = 64;
+	while (bucket_count < 2 * entries.size())
+		bucket_count *= 2;
+
+	// Counting sort of the entries by bucket
+	bucket_start.assign(bucket_count + 1, 0);
+	for (size_t k = 0; k < entries.size(); k++) {
+		entries[k].bucket = bucket_of(entry_cells[k].first, entry_cells[k].second);
+		bucket_start[entries[k].bucket + 1]++;
+	}
+	for (unsigned int b = 0; b < bucket_count; b++)
+		bucket_start[b + 1] += bucket_start[b];
+	sorted_items.resize(entries.size());
+	for (const Entry& entry : entries)
+		sorted_items[--bucket_start[entry.bucket + 1]] = entry.item;
+	// The decrements above moved the end of every bucket back to its start, shift them into place
+	for (unsigned int b = 0; b < bucket_count; b++)
+		bucket_start[b] = bucket_start[b + 1];
+	bucket_start[bucket_count] = (unsigned int)entries.size();
+}
+
+void SpatialHashGrid::collect_pairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs)
+{
+	// Every pair of items that share a bucket, possibly several times if they share several cells
+	raw_pairs.clear();
+	for (unsigned int b = 0; b < bucket_count && !bucket_start.empty(); b++) {
+		unsigned int begin = bucket_start[b];
+		unsigned int end = bucket_start[b + 1];
+		for (unsigned int k = begin; k < end; k++)
+			for (unsigned int l = k + 1; l < end; l++) {
+				unsigned int a = sorted_items[k];
+				unsigned int c = sorted_items[l];
+				if (a != c)
+					raw_pairs.push_back(a < c ? std::make_pair(a, c) : std::make_pair(c, a));
+			}
+	}
+
+	// Counting sort by the first item, then sort the few pairs of each first item by the second one.
+	// Much cheaper than sorting all pairs at once
+	pair_start.assign(max_item + 2, 0);
+	for (const auto& pair : raw_pairs)
+		pair_start[pair.first + 1]++;
+	for (unsigned int i = 0; i <= max_item; i++)
+		pair_start[i + 1] += pair_start[i];
+	pairs.resize(raw_pairs.size());
+	for (const auto& pair : raw_pairs)
+		pairs[--pair_start[pair.first + 1]] = pair;
+
+	size_t write = 0;
+	for (unsigned int i = 0; i <= max_item; i++) {
+		// the decrements above left pair_start[i + 1] at the start of the pairs of i
+		size_t begin = pair_start[i + 1];
+		size_t end = i < max_item ? pair_start[i + 2] : raw_pairs.size();
+		std::sort(pairs.begin() + begin, pairs.begin() + end);
+		for (size_t k = begin; k < end; k++)
+			if (write == 0 || pairs[k] != pairs[write - 1])
+				pairs[write++] = pairs[k];
+	}
+	pairs.resize(write);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "common.hpp"
+
+// Uniform grid over the world whose cells are hashed into a bucket array sized to the number of entries,
+// so it covers an unbounded area without a map. Items are small integers chosen by the caller (e.g. slots).
+// Rebuild every step: clear(), insert() every item, then build(). The buffers keep their capacity,
+// so steady-state rebuilds do not allocate.
+class SpatialHashGrid
+{
+public:
+	explicit SpatialHashGrid(float cell_size);
+
+	void clear();
+
+	// Adds an item covering the axis aligned box [box_min, box_max], it is put in every cell the box touches
+	void insert(unsigned int item, vec2 box_min, vec2 box_max);
+
+	// Sorts the entries into their buckets, call after the inserts and before any query
+	void build();
+
+	// Candidate pairs (a, b) with a < b of items that share a bucket, sorted by a then b and without duplicates.
+	// Every pair whose boxes overlap is included, the rest are false positives to be filtered by the caller.
+	void collect_pairs(std::vector<std::pair<unsigned int, unsigned int>>& pairs);
+
+	// Calls fn(item) for the items in the buckets the box [box_min, box_max] touches.
+	// An item can be reported more than once, and items outside the box can be reported.
+	template <typename Fn>
+	void query(vec2 box_min, vec2 box_max, Fn fn) const {
+		if (bucket_start.empty())
+			return;
+		int min_x, min_y, max_x, max_y;
+		cell_range(box_min, box_max, min_x, min_y, max_x, max_y);
+		for (int y = min_y; y <= max_y; y++)
+			for (int x = min_x; x <= max_x; x++) {
+				unsigned int bucket = bucket_of(x, y);
+				for (unsigned int k = bucket_start[bucket]; k < bucket_start[bucket + 1]; k++)
+					fn(sorted_items[k]);
+			}
+	}
+
+	float get_cell_size() const { return cell_size; }
+
+private:
+	struct Entry {
+		unsigned int bucket;
+		unsigned int item;
+	};
+
+	void cell_range(vec2 box_min, vec2 box_max, int& min_x, int& min_y, int& max_x, int& max_y) const;
+	unsigned int bucket_of(int x, int y) const {
+		return ((unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u) & (bucket_count - 1);
+	}
+
+	float cell_size;
+	unsigned int bucket_count = 1;	// power of two
+	std::vector<Entry> entries;
+	std::vector<unsigned int> bucket_start;	// bucket b holds sorted_items[bucket_start[b], bucket_start[b + 1])
+	std::vector<unsigned int> sorted_items;
+	std::vector<std::pair<int, int>> entry_cells;	// cell of each entry, hashed in build()
+	unsigned int max_item = 0;
+
+	// Scratch buffers of collect_pairs
+	std::vector<std::pair<unsigned int, unsigned int>> raw_pairs;
+	std::vector<unsigned int> pair_start;
+};
@@ -48,6 +48,7 @@ bool DialogSystem::has_pending() {
 
 void DialogSystem::clear_pending_dialogs() {
 	registry.remove_all_components_of(rendered_entity);
+	rendered_entity = Entity(); // the removed id is recycled
 	current_status = DIALOG_STATUS::DISPLAY;
 	while(!dialogs.empty()) {
 		dialogs.pop();
@@ -67,7 +68,7 @@ bool DialogSystem::step(float elapsed_ms) {
 		}
 		switch (current_status) {
 		case (DIALOG_STATUS::DISPLAY): {
-			Transform& transform = registry.transforms.emplace(rendered_entity);
+			TransformRef transform = registry.transforms.emplace(rendered_entity);
 			transform.position = current_stage.instruction_position;
 			transform.scale = { DIALOG_TEXTURE_SIZE.x, DIALOG_TEXTURE_SIZE.y };
 			transform.is_screen_coord = true;
@@ -89,6 +90,7 @@ bool DialogSystem::step(float elapsed_ms) {
 			skip_timer = fmax(skip_timer - elapsed_ms, 0.f);
 			if (current_stage.is_action_performed()) {
 				registry.remove_all_components_of(rendered_entity);
+				rendered_entity = Entity();
 				// UPDATED: Removed action timer based on feedback from users
 				current_status = DIALOG_STATUS::DISPLAY;
 				dialogs.pop();
@@ -179,7 +179,7 @@ void EffectsSystem::handle_lots_of_bullets() {
 /*************************[ negative effects ]*************************/
 
 void EffectsSystem::handle_slow_effect() {
-	Motion& motion = registry.motions.get(player);
+	MotionRef motion = registry.motions.get(player);
 	float prev_acceleration = motion.acceleration_unit;
 	float prev_max_velocity = motion.max_velocity;
 	motion.acceleration_unit = 0.3f;
@@ -190,7 +190,7 @@ void EffectsSystem::handle_slow_effect() {
 	TimedEvent& effect_timer = registry.timedEvents.emplace(entity);
 	effect_timer.timer_ms = 4000;
 	effect_timer.callback = [this, prev_acceleration, prev_max_velocity]() {
-		Motion& motion = registry.motions.get(player);
+		MotionRef motion = registry.motions.get(player);
 		motion.acceleration_unit = prev_acceleration;
 		motion.max_velocity = prev_max_velocity;
 		getEffect(CYST_EFFECT_ID::SLOW).is_active = false;
@@ -297,7 +297,7 @@ void EffectsSystem::playSound(CYST_EFFECT_ID id) {
 void EffectsSystem::displayEffect(Entity effect, CYST_EFFECT_ID id) {
 	int icon_offset = effect_to_position[id]; // can improve to fill gaps
 	float offset = icon_offset * ICON_SIZE.x * ICON_SCALE + (PADDING * icon_offset);
-	Transform& transform = registry.transforms.emplace(effect);
+	TransformRef transform = registry.transforms.emplace(effect);
 	transform.position = EFFECTS_POSITION;
 	transform.position.x += offset;
 	transform.scale = ICON_SIZE * ICON_SCALE;
@@ -20,7 +20,7 @@ MENU_OPTION MenuSystem::poll_start_menu() {
     }
 
     MENU_OPTION selected_option = MENU_OPTION::NONE;
-    Entity entity;
+    Entity entity = Entity::null();
     for (uint i = 0; i < registry.menuButtons.size(); i++) {
         entity = registry.menuButtons.entities[i];
         if (check_button_click(entity)) {
@@ -62,7 +62,7 @@ MENU_OPTION MenuSystem::poll_pause_menu() {
     }
     
     MENU_OPTION selected_option = MENU_OPTION::NONE;
-    Entity entity;
+    Entity entity = Entity::null();
     for (uint i = 0; i < registry.menuButtons.size(); i++) {
         entity = registry.menuButtons.entities[i];
         if (check_button_click(entity)) {
@@ -97,7 +97,7 @@ MENU_OPTION MenuSystem::poll_pause_menu() {
 
 Entity MenuSystem::create_menu_button(vec2 pos, TEXTURE_ASSET_ID texture, MENU_OPTION option) {
     auto entity = Entity();
-    Transform& transform = registry.transforms.emplace(entity);
+    TransformRef transform = registry.transforms.emplace(entity);
     transform.position = pos;
     transform.scale = MENU_BUTTON_TEXTURE_SIZE * 0.5f;
     transform.is_screen_coord = true;
@@ -117,7 +117,7 @@ Entity MenuSystem::create_menu_button(vec2 pos, TEXTURE_ASSET_ID texture, MENU_O
 
 Entity MenuSystem::create_menu_bg() {
     auto bg_entity = Entity();
-    Transform& bg_transform = registry.transforms.emplace(bg_entity);
+    TransformRef bg_transform = registry.transforms.emplace(bg_entity);
     bg_transform.position = {0.f, 0.f};
     bg_transform.scale = {CONTENT_WIDTH_PX, CONTENT_HEIGHT_PX};
     bg_transform.is_screen_coord = true;
@@ -143,7 +143,7 @@ void MenuSystem::draw_start_menu() {
 
     // Create title
     auto title_entity = Entity();
-    Transform& title_transform = registry.transforms.emplace(title_entity);
+    TransformRef title_transform = registry.transforms.emplace(title_entity);
     title_transform.position = {0.f, 320.f};
     title_transform.scale = START_TITLE_TEXTURE_SIZE * 0.4f;
     title_transform.is_screen_coord = true;
@@ -182,7 +182,7 @@ void MenuSystem::draw_pause_menu() {
 
     // Create title (Game Paused)
     auto title_entity = Entity();
-    Transform& title_transform = registry.transforms.emplace(title_entity);
+    TransformRef title_transform = registry.transforms.emplace(title_entity);
     title_transform.position = {0.f, 400.f};
     title_transform.scale = PAUSE_TITLE_TEXTURE_SIZE;
     title_transform.is_screen_coord = true;
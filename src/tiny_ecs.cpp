@@ -1,5 +1,53 @@
 // internal
 #include "tiny_ecs.hpp"
 
-// All we need to store besides the containers is the id of every entity and callbacks to be able to remove entities across containers
-unsigned int Entity::id_count = 1;
\ No newline at end of file
+#include <deque>
+
+// All we need to store besides the containers is the generation of every entity index and the indices free for re-use
+namespace
+{
+	std::vector<unsigned int>& generations()
+	{
+		static std::vector<unsigned int> gens(1, 0); // index 0 is reserved for the null entity
+		return gens;
+	}
+
+	std::deque<unsigned int>& free_indices()
+	{
+		static std::deque<unsigned int> indices;
+		return indices;
+	}
+}
+
+unsigned int Entity::allocate()
+{
+	std::vector<unsigned int>& gens = generations();
+	std::deque<unsigned int>& free_list = free_indices();
+	unsigned int index;
+	if (free_list.size() > Entity::MIN_FREE_INDICES) {
+		index = free_list.front();
+		free_list.pop_front();
+	}
+	else {
+		index = (unsigned int)gens.size();
+		assert(index <= INDEX_MASK && "Too many live entities");
+		gens.push_back(0);
+	}
+	return (gens[index] << INDEX_BITS) | index;
+}
+
+bool Entity::alive(Entity e)
+{
+	std::vector<unsigned int>& gens = generations();
+	unsigned int index = e.index();
+	return index != 0 && index < gens.size() && gens[index] == e.generation();
+}
+
+void Entity::release(Entity e)
+{
+	if (!alive(e))
+		return;
+	unsigned int index = e.index();
+	generations()[index] = (generations()[index] + 1) & GENERATION_MASK;
+	free_indices().push_back(index);
+}
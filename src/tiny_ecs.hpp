@@ -1,50 +1,391 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <set>
 #include <functional>
 #include <typeindex>
+#include <typeinfo>
+#include <cstdio>
+#include <tuple>
+#include <utility>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+#include <new>
 #include <assert.h>
 
 // Unique identifyer for all entities
+// The id packs a slot index (low bits) and a generation (high bits). Released indices are recycled
+// with a bumped generation, so a stale handle never compares equal to the entity now using its index.
 class Entity
 {
 	unsigned int id;
-	static unsigned int id_count; // starts from 1, entit 0 is the default initialization
+	explicit Entity(unsigned int raw_id) : id(raw_id) {}
+	static unsigned int allocate();
 public:
+	static const unsigned int INDEX_BITS = 20;
+	static const unsigned int INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static const unsigned int GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+	// Indices are only recycled once this many are free, so a released index is not handed out again right away.
+	// The indices in use therefore climb to about the peak live count plus this many
+	static const unsigned int MIN_FREE_INDICES = 1024;
+
 	Entity()
 	{
-		id = id_count++;
-		// Note, indices of already deleted entities arent re-used in this simple implementation.
+		id = allocate();
 	}
-	operator unsigned int() { return id; } // this enables automatic casting to int
+	// Index 0 is never allocated, the null entity is the "no entity" placeholder
+	static Entity null() { return Entity(0u); }
+	unsigned int index() const { return id & INDEX_MASK; }
+	unsigned int generation() const { return id >> INDEX_BITS; }
+	operator unsigned int() const { return id; } // this enables automatic casting to int
+
+	// True if e was allocated and not released since
+	static bool alive(Entity e);
+	// Return the index of e to the free list, releasing a stale or null handle does nothing
+	static void release(Entity e);
 };
 
-// Common interface to refer to all containers in the ECS registry
-struct ContainerInterface
+// Keeps the bit of one container up to date in the per-entity component signatures of its registry
+struct ContainerSignature
 {
-	virtual void clear() = 0;
-	virtual size_t size() = 0;
-	virtual void remove(Entity e) = 0;
-	virtual bool has(Entity entity) = 0;
+	// Per-entity component bitmask (indexed by entity index) that this container keeps its bit up to date in
+	void set_signature(std::vector<uint64_t>* entity_signatures, unsigned int bit) {
+		signatures = entity_signatures;
+		signature_mask = uint64_t(1) << bit;
+	}
+	uint64_t signature_bit() const { return signature_mask; }
+
+protected:
+	void mark(Entity e) {
+		if (!signatures)
+			return;
+		if (e.index() >= signatures->size())
+			signatures->resize(e.index() + 1, 0);
+		(*signatures)[e.index()] |= signature_mask;
+	}
+	void unmark(Entity e) {
+		if (signatures && e.index() < signatures->size())
+			(*signatures)[e.index()] &= ~signature_mask;
+	}
+
+private:
+	std::vector<uint64_t>* signatures = nullptr;
+	uint64_t signature_mask = 0;
+};
+
+template <typename... Ts>
+struct type_list {};
+
+// Storage policies of ComponentContainer. AoS stores whole components in one array, SoA stores every field
+// of the component in its own contiguous array (see soa_layout). The default is picked by storage_policy.
+struct AoS {};
+struct SoA {};
+
+template <typename Component>
+struct storage_policy {
+	using type = AoS;
+};
+
+// Notified by the containers of an OwningGroup before and after their structure changes
+struct GroupHook
+{
+	virtual void on_insert(Entity e) = 0;
+	virtual void before_remove(Entity e) = 0;
+	virtual void on_clear() = 0;
+};
+
+// Entity bookkeeping shared by the storage policies: the dense entity array, the paged sparse array that maps
+// an entity index to its slot in O(1) without hashing, and slot removal. Derived stores the components and
+// provides move_slot(from, to), swap_slot(a, b), pop_slot(), truncate(size) and reserve_components(capacity).
+template <typename Derived>
+class SparseSet : public ContainerSignature
+{
+	// Sparse pages are allocated on first insert of an index in that range, lookups never allocate
+	enum : unsigned int {
+		PAGE_BITS = 12,
+		PAGE_SIZE = 1u << PAGE_BITS
+	};
+	std::vector<std::unique_ptr<unsigned int[]>> sparse_pages;
+
+	Derived& derived() { return static_cast<Derived&>(*this); }
+
+	// The owning group this container belongs to, if any
+	GroupHook* group = nullptr;
+
+	// Expected peak size (0 if none was set) and the largest size actually reached
+	size_t budget = 0;
+	size_t high_water = 0;
+
+	// Bumped whenever the set of entities changes, lets systems cache data derived from it
+	unsigned int structure_version = 0;
+
+	// Whether an entity was ever inserted twice, removals then have to look for the older components as well
+	bool holds_duplicates = false;
+
+	// Move the last slot into `slot` and drop the last one. The sparse entry of the removed entity is up to the caller
+	void remove_slot(unsigned int slot) {
+		unsigned int last = (unsigned int)entities.size() - 1;
+		derived().move_slot(last, slot);
+		entities[slot] = entities.back(); // the entity is only a single index, copy it.
+		if (slot_of(entities.back()) == last)
+			sparse_slot(entities.back()) = slot;
+		derived().pop_slot();
+		entities.pop_back();
+	}
+
+	void grew() {
+		high_water = entities.size();
+		if (budget > 0 && high_water == budget + 1)
+			fprintf(stderr, "Capacity budget of %zu exceeded by %s, it will grow on demand\n", budget, typeid(Derived).name());
+	}
+
+protected:
+	unsigned int* sparse_page(unsigned int page) {
+		if (page >= sparse_pages.size())
+			sparse_pages.resize(page + 1);
+		if (!sparse_pages[page]) {
+			sparse_pages[page].reset(new unsigned int[PAGE_SIZE]);
+			std::fill_n(sparse_pages[page].get(), PAGE_SIZE, (unsigned int)INVALID_SLOT);
+		}
+		return sparse_pages[page].get();
+	}
+
+	unsigned int& sparse_slot(Entity e) {
+		unsigned int index = e.index();
+		return sparse_page(index >> PAGE_BITS)[index & (PAGE_SIZE - 1)];
+	}
+
+	// Register e at the next free slot, Derived pushes its component right after
+	void push_entity(Entity e, bool check_for_duplicates) {
+		// Usually, every entity should only have one instance of each component type
+		assert(!(check_for_duplicates && has(e)) && "Entity already contained in ECS registry");
+		assert(Entity::alive(e) && "Entity was removed, its id may already be re-used");
+
+		// Duplicates share the entity, the sparse entry points to the most recent one
+		if (!check_for_duplicates && has(e))
+			holds_duplicates = true;
+		sparse_slot(e) = (unsigned int)entities.size();
+		entities.push_back(e);
+		mark(e);
+		structure_version++;
+		if (entities.size() > high_water)
+			grew();
+	}
+
+	// Called by Derived once the component of e is stored, returns the slot it ended up in
+	unsigned int inserted(Entity e) {
+		if (group)
+			group->on_insert(e);
+		return slot_of(e);
+	}
+
+	// The slot of entity e in the dense arrays, or INVALID_SLOT
+	unsigned int slot_of(Entity e) const {
+		unsigned int index = e.index();
+		unsigned int page = index >> PAGE_BITS;
+		if (page >= sparse_pages.size() || !sparse_pages[page])
+			return INVALID_SLOT;
+		return sparse_pages[page][index & (PAGE_SIZE - 1)];
+	}
+
+public:
+	enum : unsigned int { INVALID_SLOT = ~0u };
+
+	// The corresponding entities
+	std::vector<Entity> entities;
+
+	// Removals recorded while systems iterate, applied by ComponentRegistry::flush_pending
+	std::vector<Entity> pending_removes;
+
+	// Slot of e in the dense arrays (entities[slot] == e), or INVALID_SLOT if e has no component here
+	unsigned int find(Entity e) const {
+		unsigned int slot = slot_of(e);
+		if (slot < entities.size() && (unsigned int)entities[slot] == (unsigned int)e) // also rejects stale generations
+			return slot;
+		return INVALID_SLOT;
+	}
+
+	// Check if entity has a component of type 'Component'
+	bool has(Entity entity) const {
+		return find(entity) != INVALID_SLOT;
+	}
+
+	// Report the number of components of type 'Component'
+	size_t size() const
+	{
+		return entities.size();
+	}
+
+	// Remove the components of e, duplicates included, and pack the container to re-use the empty space
+	void remove(Entity e)
+	{
+		if (group && has(e))
+			group->before_remove(e);
+		unsigned int cID = find(e);
+		if (cID == INVALID_SLOT)
+			return;
+
+		sparse_slot(e) = INVALID_SLOT;
+		remove_slot(cID);
+		// The sparse entry only pointed to the most recent duplicate, walking down leaves only checked slots to move
+		if (holds_duplicates)
+			for (unsigned int slot = (unsigned int)entities.size(); slot-- > 0;)
+				if ((unsigned int)entities[slot] == (unsigned int)e)
+					remove_slot(slot);
+		// No component of e is left, the signature bit can go
+		unmark(e);
+		structure_version++;
+	}
+
+	void remove_later(Entity e) {
+		pending_removes.push_back(e);
+	}
+
+	// Remove all recorded entities with a single compaction pass instead of one swap-pop each.
+	// Survivors keep their relative order.
+	void flush_removes() {
+		// Move group members out of the group first, the compaction keeps the group region intact
+		if (group)
+			for (Entity e : pending_removes)
+				if (has(e))
+					group->before_remove(e);
+
+		bool any_removed = false;
+		for (Entity e : pending_removes) {
+			unsigned int slot = find(e);
+			if (slot != INVALID_SLOT) {
+				sparse_slot(e) = INVALID_SLOT;
+				unmark(e);
+				entities[slot] = Entity::null(); // the null entity is never stored otherwise
+				any_removed = true;
+			}
+		}
+		pending_removes.clear();
+		if (!any_removed)
+			return;
+
+		// Older duplicates of a removed entity are left with an invalid sparse entry, they go as well
+		unsigned int write = 0;
+		for (unsigned int read = 0; read < entities.size(); read++) {
+			if ((unsigned int)entities[read] == 0 || (holds_duplicates && slot_of(entities[read]) == INVALID_SLOT))
+				continue;
+			if (write != read) {
+				derived().move_slot(read, write);
+				entities[write] = entities[read];
+				if (slot_of(entities[write]) == read)
+					sparse_slot(entities[write]) = write;
+			}
+			write++;
+		}
+		derived().truncate(write);
+		entities.erase(entities.begin() + write, entities.end());
+		structure_version++;
+	}
+
+	// Remove all components of type 'Component'
+	void clear()
+	{
+		for (Entity e : entities) {
+			sparse_slot(e) = INVALID_SLOT;
+			unmark(e);
+		}
+		derived().truncate(0);
+		entities.clear();
+		holds_duplicates = false;
+		structure_version++;
+		if (group)
+			group->on_clear();
+	}
+
+	// Exchange the contents of two slots
+	void swap_slots(unsigned int a, unsigned int b) {
+		if (a == b)
+			return;
+		derived().swap_slot(a, b);
+		std::swap(entities[a], entities[b]);
+		if (slot_of(entities[a]) == b)
+			sparse_slot(entities[a]) = a;
+		if (slot_of(entities[b]) == a)
+			sparse_slot(entities[b]) = b;
+	}
+
+	// Preallocate storage for n components and the sparse pages of the entity indices that many live entities
+	// can use, n + Entity::MIN_FREE_INDICES, inserts below that size do not allocate
+	void reserve(size_t n) {
+		for (size_t index = 0; index < n + Entity::MIN_FREE_INDICES; index += PAGE_SIZE)
+			sparse_page((unsigned int)(index >> PAGE_BITS));
+		entities.reserve(n);
+		pending_removes.reserve(n);
+		derived().reserve_components(n);
+	}
+
+	// Reserve for the expected peak size, a warning is printed the first time the container grows past it
+	void set_budget(size_t n) {
+		budget = n;
+		reserve(n);
+	}
+	size_t get_budget() const {
+		return budget;
+	}
+
+	// The largest number of components this container held at once
+	size_t high_water_mark() const {
+		return high_water;
+	}
+
+	// Changes whenever entities are added or removed (not when slots are reordered)
+	unsigned int version() const {
+		return structure_version;
+	}
+
+	// Attach this container to an owning group, see OwningGroup
+	void set_group(GroupHook* owning_group) {
+		assert(!(group && owning_group) && "A container can only be owned by one group");
+		group = owning_group;
+	}
 };
 
 // A container that stores components of type 'Component' and associated entities
-template <typename Component> // A component can be any class
-class ComponentContainer : public ContainerInterface
+template <typename Component, typename Policy = typename storage_policy<Component>::type> // A component can be any class
+class ComponentContainer;
+
+// Array-of-structs storage, components live in a dense packed array
+template <typename Component>
+class ComponentContainer<Component, AoS> : public SparseSet<ComponentContainer<Component, AoS>>
 {
-private:
-	// The hash map from Entity -> array index.
-	std::unordered_map<unsigned int, unsigned int> map_entity_componentID; // the entity is cast to uint to be hashable.
-	bool registered = false;
+	using Base = SparseSet<ComponentContainer<Component, AoS>>;
+	friend Base;
+	using Base::slot_of;
+	using Base::sparse_slot;
+
+	void move_slot(unsigned int from, unsigned int to) {
+		// Note, components[to] = components[from] would trigger the copy instead of move operator
+		components[to] = std::move(components[from]);
+	}
+	void swap_slot(unsigned int a, unsigned int b) {
+		using std::swap;
+		swap(components[a], components[b]);
+	}
+	void pop_slot() { components.pop_back(); }
+	void truncate(size_t n) { components.erase(components.begin() + n, components.end()); }
+	void reserve_components(size_t n) {
+		components.reserve(n);
+	}
 public:
+	using reference = Component&;
+	using Base::entities;
+	using Base::has;
+	using Base::find;
+
 	// Container of all components of type 'Component'
 	std::vector<Component> components;
 
-	// The corresponding entities
-	std::vector<Entity> entities;
+	// Inserts recorded while systems iterate, applied by ComponentRegistry::flush_pending
+	std::vector<std::pair<Entity, Component>> pending_inserts;
 
 	// Constructor that registers the type
 	ComponentContainer()
@@ -54,19 +395,16 @@ public:
 	// Update a component associated with an entity
 	inline void update(Entity e, const Component& c) {
         assert(has(e) && "Entity not contained in ECS registry");
-        components[map_entity_componentID[e]] = c;
+        components[find(e)] = c;
     }
 
-	// Inserting a component c associated to entity e
+	// Inserting a component c associated to entity e. If the container is a member of an OwningGroup, this may move
+	// other entities' components in every member, so references taken from any member before are invalid
 	inline Component& insert(Entity e, Component c, bool check_for_duplicates = true)
 	{
-		// Usually, every entity should only have one instance of each component type
-		assert(!(check_for_duplicates && has(e)) && "Entity already contained in ECS registry");
-
-		map_entity_componentID[e] = (unsigned int)components.size();
+		this->push_entity(e, check_for_duplicates);
 		components.push_back(std::move(c)); // the move enforces move instead of copy constructor
-		entities.push_back(e);
-		return components.back();
+		return components[this->inserted(e)];
 	};
 
 	// The emplace function takes the the provided arguments Args, creates a new object of type Component, and inserts it into the ECS system
@@ -82,62 +420,660 @@ public:
 	// A wrapper to return the component of an entity
 	Component& get(Entity e) {
 		assert(has(e) && "Entity not contained in ECS registry");
-		return components[map_entity_componentID[e]];
+		return components[find(e)];
 	}
 
-	// Check if entity has a component of type 'Component'
-	bool has(Entity entity) {
-		return map_entity_componentID.count(entity) > 0;
+	// Pointer to the component of an entity, or nullptr if it has none. One lookup instead of has() + get()
+	Component* try_get(Entity e) {
+		unsigned int slot = find(e);
+		return slot != Base::INVALID_SLOT ? &components[slot] : nullptr;
 	}
 
-	// Remove an component and pack the container to re-use the empty space
-	void remove(Entity e)
-	{
-		if (has(e))
-		{
-			// Get the current position
-			int cID = map_entity_componentID[e];
-
-			// Move the last element to position cID using the move operator
-			// Note, components[cID] = components.back() would trigger the copy instead of move operator
-			components[cID] = std::move(components.back());
-			entities[cID] = entities.back(); // the entity is only a single index, copy it.
-			map_entity_componentID[entities.back()] = cID;
-
-			// Erase the old component and free its memory
-			map_entity_componentID.erase(e);
-			components.pop_back();
-			entities.pop_back();
-			// Note, one could mark the id for re-use
-		}
-	};
+	// The component at a dense slot
+	Component& at(unsigned int slot) {
+		return components[slot];
+	}
 
-	// Remove all components of type 'Component'
-	void clear()
-	{
-		map_entity_componentID.clear();
-		components.clear();
-		entities.clear();
+	// Deferred version of insert
+	void insert_later(Entity e, Component c) {
+		pending_inserts.emplace_back(e, std::move(c));
 	}
 
-	// Report the number of components of type 'Component'
-	size_t size()
-	{
-		return components.size();
+	// Insert the recorded components, skipping entities that were removed in the meantime
+	void flush_inserts() {
+		for (auto& pending : pending_inserts)
+			if (Entity::alive(pending.first))
+				insert(pending.first, std::move(pending.second));
+		pending_inserts.clear();
 	}
 
 	// Sort the components and associated entity assignment structures by the comparisonFunction, see std::sort
 	template <class Compare>
 	void sort(Compare comparisonFunction)
 	{
-		// First sort the entity list as desired
-		std::sort(entities.begin(), entities.end(), comparisonFunction);
-		// Now re-arrange the components (Note, creates a new vector, which may be slow! Not sure if in-place could be faster: https://stackoverflow.com/questions/63703637/how-to-efficiently-permute-an-array-in-place-using-stdswap)
+		// Sort the slot order by entity, then gather the components in that order
+		std::vector<unsigned int> order(entities.size());
+		for (unsigned int i = 0; i < order.size(); i++)
+			order[i] = i;
+		assert(!this->group && "Sorting would break the order of the owning group");
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return comparisonFunction(entities[a], entities[b]); });
 		std::vector<Component> components_new; components_new.reserve(components.size());
-		std::transform(entities.begin(), entities.end(), std::back_inserter(components_new), [&](Entity e) { return std::move(get(e)); }); // note, the get still uses the old hash map (on purpose!)
-		components = std::move(components_new); // note, we use move operations to not create unneccesary copies of objects, but memory is still allocated for the new vector
-		// Fill the new hashmap
+		std::vector<Entity> entities_new; entities_new.reserve(entities.size());
+		for (unsigned int i : order) {
+			components_new.push_back(std::move(components[i]));
+			entities_new.push_back(entities[i]);
+		}
+		components = std::move(components_new);
+		entities = std::move(entities_new);
 		for (unsigned int i = 0; i < entities.size(); i++)
-			map_entity_componentID[entities[i]] = i;
+			sparse_slot(entities[i]) = i;
+	}
+};
+
+// A growable array of trivially copyable values whose storage is aligned to SOA_ALIGNMENT bytes,
+// used for the columns of SoA containers (std::vector<bool> could not hand out bool&)
+const size_t SOA_ALIGNMENT = 64;
+
+template <typename T>
+class soa_column
+{
+	static_assert(std::is_trivially_copyable<T>::value, "SoA fields must be trivially copyable");
+	T* values = nullptr;
+	void* allocation = nullptr;
+	size_t count = 0;
+	size_t capacity = 0;
+public:
+	soa_column() {}
+	soa_column(const soa_column&) = delete;
+	soa_column& operator=(const soa_column&) = delete;
+	~soa_column() { ::operator delete(allocation); }
+
+	void reserve(size_t n) {
+		if (n <= capacity)
+			return;
+		void* new_allocation = ::operator new(n * sizeof(T) + SOA_ALIGNMENT);
+		uintptr_t address = (reinterpret_cast<uintptr_t>(new_allocation) + SOA_ALIGNMENT - 1) & ~(uintptr_t)(SOA_ALIGNMENT - 1);
+		T* new_values = reinterpret_cast<T*>(address);
+		if (count > 0)
+			std::memcpy(new_values, values, count * sizeof(T));
+		::operator delete(allocation);
+		allocation = new_allocation;
+		values = new_values;
+		capacity = n;
+	}
+	void push_back(const T& value) {
+		if (count == capacity)
+			reserve(capacity == 0 ? 16 : capacity * 2);
+		values[count++] = value;
+	}
+	void pop_back() { count--; }
+	void resize_down(size_t n) { count = n; }
+	size_t size() const { return count; }
+	T& operator[](size_t i) { return values[i]; }
+	const T& operator[](size_t i) const { return values[i]; }
+	T* data() { return values; }
+};
+
+// One field of a component stored as structure-of-arrays
+template <typename Component, typename Field, Field Component::*Member>
+struct soa_field {
+	using type = Field;
+	static Field Component::* member() { return Member; }
+};
+
+// Specialize for components stored as SoA. Provides
+//   fields:    type_list of soa_field, one per member, in declaration order
+//   reference: an aggregate of references to the fields, in the same order as fields, which get() returns,
+//              followed by a soa_ref_check member named check
+template <typename Component>
+struct soa_layout;
+
+// Debug check of an SoA reference proxy. Inserting into a member of an OwningGroup can move the slots of other
+// entities in every member, so a proxy taken before the insert may point at another entity's fields. Destroying
+// a proxy asserts if its entity is still in the container but at another slot than the one it was taken at.
+// Empty in release builds.
+class soa_ref_check
+{
+#ifndef NDEBUG
+	using find_fn = unsigned int (*)(const void* container, Entity e);
+	const void* container = nullptr;
+	find_fn find = nullptr;
+	Entity entity = Entity::null();
+	unsigned int slot = 0;
+public:
+	soa_ref_check() {}
+	soa_ref_check(const void* container, find_fn find, Entity entity, unsigned int slot)
+		: container(container), find(find), entity(entity), slot(slot) {}
+	soa_ref_check(const soa_ref_check&) = default;
+	soa_ref_check& operator=(const soa_ref_check&) = default;
+	~soa_ref_check() {
+		if (!find)
+			return;
+		unsigned int now = find(container, entity);
+		assert((now == ~0u || now == slot) && "Component moved while a reference to it was held, get() it again after inserting");
+	}
+#endif
+};
+
+// Structure-of-arrays storage: every field of the component lives in its own aligned array, so loops that only
+// touch a few fields (e.g. positions and velocities) stream just those. get() returns a reference proxy with one
+// reference per field, and field(&Component::member) gives the raw array of one field.
+template <typename Component>
+class ComponentContainer<Component, SoA> : public SparseSet<ComponentContainer<Component, SoA>>
+{
+	using Base = SparseSet<ComponentContainer<Component, SoA>>;
+	friend Base;
+	using Fields = typename soa_layout<Component>::fields;
+
+	template <typename List>
+	struct columns_of;
+	template <typename... Fs>
+	struct columns_of<type_list<Fs...>> {
+		using type = std::tuple<soa_column<typename Fs::type>...>;
+		using indices = std::index_sequence_for<Fs...>;
+	};
+	using Columns = typename columns_of<Fields>::type;
+	using all_fields = typename columns_of<Fields>::indices;
+	using expand = int[];
+
+	Columns columns;
+
+	template <size_t... I>
+	void move_slot(unsigned int from, unsigned int to, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(columns)[to] = std::get<I>(columns)[from], 0)... };
+	}
+	void move_slot(unsigned int from, unsigned int to) { move_slot(from, to, all_fields{}); }
+
+	template <size_t... I>
+	void swap_slot(unsigned int a, unsigned int b, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::swap(std::get<I>(columns)[a], std::get<I>(columns)[b]), 0)... };
+	}
+	void swap_slot(unsigned int a, unsigned int b) { swap_slot(a, b, all_fields{}); }
+
+	template <size_t... I>
+	void pop_slot(std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(columns).pop_back(), 0)... };
+	}
+	void pop_slot() { pop_slot(all_fields{}); }
+
+	template <size_t... I>
+	void truncate(size_t n, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(columns).resize_down(n), 0)... };
+	}
+	void truncate(size_t n) { truncate(n, all_fields{}); }
+
+	template <size_t... I>
+	void reserve_components(size_t n, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(columns).reserve(n), 0)... };
+	}
+	void reserve_components(size_t n) {
+		reserve_components(n, all_fields{});
+	}
+
+	template <typename... Fs, size_t... I>
+	void push(const Component& c, type_list<Fs...>, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(columns).push_back(c.*Fs::member()), 0)... };
+	}
+
+	template <typename... Fs, size_t... I>
+	void write(unsigned int slot, const Component& c, type_list<Fs...>, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(columns)[slot] = c.*Fs::member(), 0)... };
+	}
+
+	template <size_t... I>
+	typename soa_layout<Component>::reference reference_at(unsigned int slot, std::index_sequence<I...>) {
+		return { std::get<I>(columns)[slot]..., ref_check(slot) };
+	}
+#ifndef NDEBUG
+	soa_ref_check ref_check(unsigned int slot) const {
+		return soa_ref_check(this, &find_in, this->entities[slot], slot);
+	}
+	static unsigned int find_in(const void* container, Entity e) {
+		return static_cast<const ComponentContainer*>(container)->find(e);
+	}
+#else
+	soa_ref_check ref_check(unsigned int) const {
+		return soa_ref_check();
+	}
+#endif
+
+	template <typename F, typename... Fs, size_t... I>
+	F* find_field(F Component::* member, type_list<Fs...>, std::index_sequence<I...>) {
+		F* found = nullptr;
+		(void)expand{ 0, (found = found ? found : column_if_match<F, Fs>(member, std::get<I>(columns)), 0)... };
+		return found;
+	}
+	template <typename F, typename Fi, typename Column>
+	F* column_if_match(F Component::* member, Column& column, typename std::enable_if<std::is_same<F, typename Fi::type>::value>::type* = nullptr) {
+		return Fi::member() == member ? column.data() : nullptr;
+	}
+	template <typename F, typename Fi, typename Column>
+	F* column_if_match(F Component::*, Column&, typename std::enable_if<!std::is_same<F, typename Fi::type>::value>::type* = nullptr) {
+		return nullptr;
+	}
+public:
+	using reference = typename soa_layout<Component>::reference;
+	using Base::entities;
+	using Base::has;
+	using Base::find;
+
+	// Inserts recorded while systems iterate, applied by ComponentRegistry::flush_pending
+	std::vector<std::pair<Entity, Component>> pending_inserts;
+
+	// Update a component associated with an entity
+	void update(Entity e, const Component& c) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		write(find(e), c, Fields{}, all_fields{});
+	}
+
+	// Inserting a component c associated to entity e. If the container is a member of an OwningGroup, this may move
+	// other entities' components in every member, so references taken from any member before are invalid
+	reference insert(Entity e, const Component& c, bool check_for_duplicates = true) {
+		this->push_entity(e, check_for_duplicates);
+		push(c, Fields{}, all_fields{});
+		return at(this->inserted(e));
+	}
+
+	template<typename... Args>
+	reference emplace(Entity e, Args &&... args) {
+		return insert(e, Component(std::forward<Args>(args)...));
+	}
+	template<typename... Args>
+	reference emplace_with_duplicates(Entity e, Args &&... args) {
+		return insert(e, Component(std::forward<Args>(args)...), false);
+	}
+
+	// Reference proxy to the fields of an entity's component
+	reference get(Entity e) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		return at(find(e));
+	}
+
+	// The component at a dense slot
+	reference at(unsigned int slot) {
+		return reference_at(slot, all_fields{});
+	}
+
+	// The contiguous array of one field for all slots, e.g. field(&Transform::position)[slot]
+	template <typename F>
+	F* field(F Component::* member) {
+		F* column = find_field(member, Fields{}, all_fields{});
+		assert(column || entities.empty());
+		return column;
+	}
+
+	// Deferred version of insert
+	void insert_later(Entity e, Component c) {
+		pending_inserts.emplace_back(e, std::move(c));
+	}
+
+	// Insert the recorded components, skipping entities that were removed in the meantime
+	void flush_inserts() {
+		for (auto& pending : pending_inserts)
+			if (Entity::alive(pending.first))
+				insert(pending.first, pending.second);
+		pending_inserts.clear();
+	}
+};
+
+
+// Keeps the entities that have a component in every one of Containers packed at the front of each container,
+// in the same order. Slot i < size() of one member holds the same entity as slot i of every other member,
+// so systems can walk the members in lockstep without any lookup. The members are kept up to date on every
+// insert and remove; a container can be owned by at most one group.
+// An insert into any member that completes an entity swaps it with the entity at slot size() in every member,
+// so references and proxies into any member taken before an insert or remove are invalid afterwards: insert all
+// the grouped components first, then get() the references.
+template <typename... Containers>
+class OwningGroup : public GroupHook
+{
+	static_assert(sizeof...(Containers) > 1, "A group needs at least two containers");
+
+	std::tuple<Containers*...> members;
+	unsigned int group_size = 0;
+
+	using all_members = std::index_sequence_for<Containers...>;
+	using expand = int[];
+
+	template <size_t... I>
+	bool in_all(Entity e, std::index_sequence<I...>) const {
+		bool all = true;
+		(void)expand{ 0, (all = all && std::get<I>(members)->has(e), 0)... };
+		return all;
+	}
+
+	// Swap e into slot `to` of every member
+	template <size_t... I>
+	void move_to(Entity e, unsigned int to, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(members)->swap_slots(std::get<I>(members)->find(e), to), 0)... };
+	}
+
+	template <size_t... I>
+	void swap_in_all(unsigned int a, unsigned int b, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(members)->swap_slots(a, b), 0)... };
+	}
+
+	template <size_t... I>
+	void attach(GroupHook* hook, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(members)->set_group(hook), 0)... };
+	}
+
+	bool contains(Entity e) const {
+		return std::get<0>(members)->find(e) < group_size;
+	}
+public:
+	explicit OwningGroup(Containers&... containers)
+		: members(&containers...)
+	{
+		attach(this, all_members{});
+		// Adopt entities that are already in every member
+		auto& first = *std::get<0>(members);
+		for (unsigned int i = 0; i < first.size(); i++)
+			on_insert(first.entities[i]);
+	}
+	~OwningGroup() {
+		attach(nullptr, all_members{});
+	}
+	OwningGroup(const OwningGroup&) = delete;
+	OwningGroup& operator=(const OwningGroup&) = delete;
+
+	// Number of entities in the group, they occupy slots [0, size()) of every member
+	unsigned int size() const {
+		return group_size;
+	}
+
+	// Exchange two slots of the group region in every member, the group stays co-sorted
+	void swap_slots(unsigned int a, unsigned int b) {
+		assert(a < group_size && b < group_size);
+		swap_in_all(a, b, all_members{});
+	}
+
+	void on_insert(Entity e) override {
+		if (contains(e) || !in_all(e, all_members{}))
+			return;
+		move_to(e, group_size, all_members{});
+		group_size++;
+	}
+
+	void before_remove(Entity e) override {
+		if (!contains(e))
+			return;
+		group_size--;
+		move_to(e, group_size, all_members{});
+	}
+
+	void on_clear() override {
+		group_size = 0;
+	}
+};
+
+// Iterates all entities that have every component in Include and none in Exclude, see ECSRegistry::view.
+// Iteration is driven by the smallest included container and each component is looked up once per entity.
+// The callback may modify components but must not add or remove components of the viewed types.
+template <typename Registry, typename Include, typename Exclude>
+class View;
+
+template <typename Registry, typename... Ts, typename... Ex>
+class View<Registry, type_list<Ts...>, type_list<Ex...>>
+{
+	static_assert(sizeof...(Ts) > 0, "A view needs at least one component type");
+	enum : unsigned int { INVALID_SLOT = ~0u };
+
+	Registry& reg;
+	std::tuple<ComponentContainer<Ts>*...> included;
+	std::tuple<ComponentContainer<Ex>*...> excluded;
+
+	template <size_t... I>
+	size_t smallest(std::index_sequence<I...>) const {
+		const size_t sizes[] = { std::get<I>(included)->size()... };
+		size_t driver = 0;
+		for (size_t k = 1; k < sizeof...(I); k++)
+			if (sizes[k] < sizes[driver])
+				driver = k;
+		return driver;
+	}
+
+	template <size_t... J>
+	bool is_excluded(Entity e, std::index_sequence<J...>) const {
+		(void)e;	// unused without excluded types
+		bool any = false;
+		using expand = bool[];
+		(void)expand{ false, (any = any || std::get<J>(excluded)->find(e) != INVALID_SLOT)... };
+		return any;
+	}
+
+	// Slot of the entity at slot i of the driving container D in included container I, the driver itself needs no lookup
+	template <size_t I, size_t D>
+	unsigned int fetch(size_t i, Entity e) const {
+		return I == D ? (unsigned int)i : std::get<I>(included)->find(e);
+	}
+
+	// Look up the component slots in order, stopping at the first one the entity does not have
+	template <size_t D, size_t N>
+	bool gather(size_t, Entity, unsigned int (&)[N], std::index_sequence<>) const {
+		return true;
+	}
+
+	template <size_t D, size_t N, size_t I, size_t... Rest>
+	bool gather(size_t i, Entity e, unsigned int (&slots)[N], std::index_sequence<I, Rest...>) const {
+		slots[I] = fetch<I, D>(i, e);
+		return slots[I] != INVALID_SLOT && gather<D>(i, e, slots, std::index_sequence<Rest...>{});
+	}
+
+	// Iterate entities, which are stored in included container D (or D == sizeof...(Ts) for any other container)
+	template <size_t D, typename Fn, size_t... I>
+	void each_of(const std::vector<Entity>& entities, Fn& fn, std::index_sequence<I...> seq) const {
+		unsigned int slots[sizeof...(Ts)];
+		for (size_t i = 0; i < entities.size(); i++) {
+			Entity e = entities[i];
+			if (!gather<D>(i, e, slots, seq) || is_excluded(e, std::index_sequence_for<Ex...>{}))
+				continue;
+			fn(e, std::get<I>(included)->at(slots[I])...);
+		}
+	}
+
+	template <typename Fn, size_t... I>
+	void each_smallest(Fn& fn, std::index_sequence<I...> seq) const {
+		// Driver index is a runtime value, dispatch to the loop instantiated for it
+		using Loop = void (View::*)(const std::vector<Entity>&, Fn&, std::index_sequence<I...>) const;
+		static const Loop loops[] = { &View::template each_of<I, Fn, I...>... };
+		const std::vector<Entity>* candidates[] = { &std::get<I>(included)->entities... };
+		size_t driver = smallest(seq);
+		(this->*loops[driver])(*candidates[driver], fn, seq);
+	}
+public:
+	explicit View(Registry& reg)
+		: reg(reg), included(&reg.template get<Ts>()...), excluded(&reg.template get<Ex>()...) {}
+
+	// The same view, additionally skipping entities that have any of More
+	template <typename... More>
+	View<Registry, type_list<Ts...>, type_list<Ex..., More...>> exclude() const {
+		return View<Registry, type_list<Ts...>, type_list<Ex..., More...>>(reg);
+	}
+
+	// Calls fn(Entity, Ts&...) for every matching entity, SoA components are passed as their reference proxy
+	template <typename Fn>
+	void each(Fn fn) const {
+		each_smallest(fn, std::index_sequence_for<Ts...>{});
+	}
+
+	// Like each, but visits entities in the storage order of Driver (e.g. to keep a stable draw order)
+	template <typename Driver, typename Fn>
+	void each_in_order_of(Fn fn) const {
+		// an index past the included types, so every component is looked up
+		each_of<sizeof...(Ts)>(reg.template get<Driver>().entities, fn, std::index_sequence_for<Ts...>{});
+	}
+};
+
+// Position of T in Ts..., fails to compile if T is not in the list
+template <typename T, typename... Ts>
+struct type_index;
+
+template <typename T, typename... Ts>
+struct type_index<T, T, Ts...> : std::integral_constant<unsigned int, 0> {};
+
+template <typename T, typename U, typename... Ts>
+struct type_index<T, U, Ts...> : std::integral_constant<unsigned int, 1 + type_index<T, Ts...>::value> {};
+
+// Owns one ComponentContainer per type in Components. The container set is fixed at compile time, so
+// clearing, listing and removing expand over the type list without virtual calls, and there is no
+// separate list of containers to keep in sync. The position of a type in the list is its signature bit.
+template <typename... Components>
+class ComponentRegistry
+{
+	static_assert(sizeof...(Components) <= 64, "Signature bitmask is full");
+
+	std::tuple<ComponentContainer<Components>...> containers;
+
+	// Bitmask of the containers each entity has a component in, indexed by entity index
+	std::vector<uint64_t> signatures;
+
+	// Entities to remove at the next flush_pending
+	std::vector<Entity> pending_destroys;
+
+	using all_indices = std::index_sequence_for<Components...>;
+	using expand = int[];
+
+	template <size_t... I>
+	void attach_signatures(std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(containers).set_signature(&signatures, I), 0)... };
+	}
+
+	template <size_t... I>
+	void clear_all(std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(containers).clear(), 0)... };
+	}
+
+	template <size_t... I>
+	void remove_by_signature(Entity e, uint64_t signature, std::index_sequence<I...>) {
+		(void)expand{ 0, ((signature & (uint64_t(1) << I)) ? std::get<I>(containers).remove(e), 0 : 0)... };
+	}
+
+	template <size_t... I>
+	void queue_removes(Entity e, uint64_t signature, std::index_sequence<I...>) {
+		(void)expand{ 0, ((signature & (uint64_t(1) << I)) ? std::get<I>(containers).remove_later(e), 0 : 0)... };
+	}
+
+	template <size_t... I>
+	void flush_all(std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(containers).flush_inserts(), 0)... };
+		for (Entity e : pending_destroys)
+			queue_removes(e, signature(e), all_indices{});
+		(void)expand{ 0, (std::get<I>(containers).flush_removes(), 0)... };
+	}
+
+	template <size_t... I>
+	void list_sizes(std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(containers).size() > 0
+			? printf("%4d components of type %s\n", (int)std::get<I>(containers).size(), typeid(std::get<I>(containers)).name())
+			: 0)... };
+	}
+
+	template <size_t... I>
+	void list_high_water(std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(containers).high_water_mark() > 0
+			? printf("%4d peak (budget %4d) components of type %s\n", (int)std::get<I>(containers).high_water_mark(),
+				(int)std::get<I>(containers).get_budget(), typeid(std::get<I>(containers)).name())
+			: 0)... };
+	}
+
+	template <size_t... I>
+	void list_of(Entity e, std::index_sequence<I...>) {
+		(void)expand{ 0, (std::get<I>(containers).has(e) ? printf("type %s\n", typeid(std::get<I>(containers)).name()) : 0)... };
+	}
+public:
+	ComponentRegistry() {
+		attach_signatures(all_indices{});
+	}
+	// Containers hold a pointer to the signatures, a copy would share them
+	ComponentRegistry(const ComponentRegistry&) = delete;
+	ComponentRegistry& operator=(const ComponentRegistry&) = delete;
+
+	// The container storing components of type Component
+	template <typename Component>
+	ComponentContainer<Component>& get() {
+		return std::get<ComponentContainer<Component>>(containers);
+	}
+
+	// Iterate all entities having every component in Ts, e.g.
+	// registry.view<Transform, Motion>().exclude<Attachment>().each([](Entity e, Transform& t, Motion& m) { ... });
+	template <typename... Ts>
+	View<ComponentRegistry, type_list<Ts...>, type_list<>> view() {
+		return View<ComponentRegistry, type_list<Ts...>, type_list<>>(*this);
+	}
+
+	void clear_all_components() {
+		clear_all(all_indices{});
+	}
+
+	void list_all_components() {
+		printf("Debug info on all registry entries:\n");
+		list_sizes(all_indices{});
+	}
+
+	// Largest size every container reached and its budget, to tune the capacity budgets
+	void list_high_water_marks() {
+		printf("Capacity high-water marks:\n");
+		list_high_water(all_indices{});
+	}
+
+	// Preallocate the per-entity bookkeeping for entity indices [0, n). This is a range of indices, not a count of
+	// entities: for a peak of live entities, reserve live + Entity::MIN_FREE_INDICES
+	void reserve_entities(size_t n) {
+		signatures.reserve(n);
+		pending_destroys.reserve(n);
+	}
+
+	void list_all_components_of(Entity e) {
+		printf("Debug info on components of entity %u:\n", (unsigned int)e);
+		list_of(e, all_indices{});
+	}
+
+	// Removes every component of e and releases its id for re-use, e is invalid afterwards
+	// Only the containers whose bit is set in the signature of e are touched
+	void remove_all_components_of(Entity e) {
+		if (!valid(e))
+			return;
+		remove_by_signature(e, signature(e), all_indices{});
+		Entity::release(e);
+	}
+
+	// Command buffer for structural changes while iterating: the changes are recorded now and applied
+	// together by flush_pending at a fixed point of the frame. Until then the entity and its components stay as they are.
+	void destroy_later(Entity e) {
+		pending_destroys.push_back(e);
+	}
+	template <typename Component>
+	void insert_later(Entity e, Component c) {
+		get<Component>().insert_later(e, std::move(c));
+	}
+	template <typename Component>
+	void remove_later(Entity e) {
+		get<Component>().remove_later(e);
+	}
+
+	// Applies the recorded changes: component inserts first, then component removals and destroys grouped
+	// per container so that each container is compacted once. Destroyed ids are released last.
+	void flush_pending() {
+		flush_all(all_indices{});
+		for (Entity e : pending_destroys)
+			Entity::release(e);
+		pending_destroys.clear();
+	}
+
+	// Bit test instead of a container lookup
+	template <typename Component>
+	bool has(Entity e) {
+		return (signature(e) & (uint64_t(1) << type_index<Component, Components...>::value)) != 0;
+	}
+
+	// The set of containers e has components in, bit i is the i-th type in Components
+	uint64_t signature(Entity e) {
+		return valid(e) && e.index() < signatures.size() ? signatures[e.index()] : 0;
+	}
+
+	// False for the null entity and for handles whose entity has been removed
+	bool valid(Entity e) {
+		return Entity::alive(e);
 	}
 };
@@ -0,0 +1,70 @@
+// internal
+#include "worker_pool.hpp"
+
+WorkerPool::WorkerPool(unsigned int thread_count)
+{
+	for (unsigned int t = 1; t < thread_count; t++)
+		workers.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	started.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void WorkerPool::run(unsigned int task_count, const std::function<void(unsigned int)>& fn)
+{
+	if (workers.empty() || task_count <= 1) {
+		for (unsigned int task = 0; task < task_count; task++)
+			fn(task);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		job_task_count = task_count;
+		next_task = 0;
+		busy_workers = (unsigned int)workers.size();
+		generation++;
+	}
+	started.notify_all();
+	take_tasks();
+
+	// every worker has to see this run through before the next one may start
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busy_workers == 0; });
+	job = nullptr;
+}
+
+void WorkerPool::take_tasks()
+{
+	for (unsigned int task = next_task++; task < job_task_count; task = next_task++)
+		(*job)(task);
+}
+
+void WorkerPool::work()
+{
+	unsigned int seen_generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			started.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping)
+				return;
+			seen_generation = generation;
+		}
+		take_tasks();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy_workers--;
+		}
+		finished.notify_one();
+	}
+}
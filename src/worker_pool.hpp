@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Fixed set of threads for data parallel loops. run() hands out task indices to the workers and the
+// calling thread until all are taken, then waits for them to finish. The threads sleep between runs.
+class WorkerPool
+{
+public:
+	// thread_count includes the calling thread, 1 runs every task on the caller
+	explicit WorkerPool(unsigned int thread_count);
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	unsigned int thread_count() const { return (unsigned int)workers.size() + 1; }
+
+	// Calls fn(task) once for every task in [0, task_count), in no particular order or thread
+	void run(unsigned int task_count, const std::function<void(unsigned int)>& fn);
+
+private:
+	void work();
+	void take_tasks();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable started, finished;
+	unsigned int generation = 0;	// bumped by every run, the workers wait for it to change
+	unsigned int busy_workers = 0;
+	bool stopping = false;
+
+	const std::function<void(unsigned int)>* job = nullptr;
+	unsigned int job_task_count = 0;
+	std::atomic<unsigned int> next_task{ 0 };
+};
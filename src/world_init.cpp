@@ -2,6 +2,7 @@
 #include "world_init.hpp"
 #include "components.hpp"
 #include "tiny_ecs_registry.hpp"
+#include "map_geometry.hpp"
 
 // stlib
 #include <vector>
@@ -13,15 +14,16 @@ Entity createPlayer(vec2 pos)
 {
 	auto entity = Entity();
 
+	// The motion goes in first, the transform insert moves the player into the movables group
+	registry.motions.insert(entity, { { 0.f, 0.f } });
+
 	// Setting initial bullet_transform values
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = pos;
 	transform.scale = PLAYER_SIZE;
 	transform.angle_offset = IMMUNITY_TEXTURE_ANGLE;
 	transform.angle = transform.angle_offset;
 
-	registry.motions.insert(entity, { { 0.f, 0.f } });
-
 	// Create an (empty) Player component to be able to refer to all players
 	Player& playerComp = registry.players.emplace(entity);
 
@@ -44,6 +46,7 @@ Entity createPlayer(vec2 pos)
 
 	// Add color for player
 	registry.colors.insert(entity, { 1.f,1.f,1.f,1.f });
+	update_collision_filter(entity);
 	return entity;
 }
 
@@ -51,6 +54,9 @@ Entity createDashing(Entity dasher) {
 	if (!registry.dashes.has(dasher)) {
 		registry.dashes.emplace(dasher);
 	}
+	if (!registry.sweptColliders.has(dasher)) {
+		registry.sweptColliders.emplace(dasher);
+	}
 	Entity dash_entity = Entity();
 	Attachment& attachment = registry.attachments.emplace(dash_entity);
 	attachment.parent = dasher;
@@ -131,7 +137,7 @@ Entity createSword(RenderSystem* renderer, Entity& holder) {
 	attachment.relative_transform_2.translate({ -0.29f, -0.39f }); // Adjust the pivot point so the handle is in hand
 
 	registry.transforms.emplace(melee_entity);
-	Motion& motion = registry.motions.emplace(melee_entity);		// This motion is with respect to parent
+	MotionRef motion = registry.motions.emplace(melee_entity);		// This motion is with respect to parent
 	motion.max_angular_velocity = 5 * M_PI;
 	registry.colors.insert(melee_entity, { 1.f,1.f,1.f,1.f });
 
@@ -142,6 +148,8 @@ Entity createSword(RenderSystem* renderer, Entity& holder) {
 			GEOMETRY_BUFFER_ID::SWORD,
 			RENDER_ORDER::PLAYER_ATTACHMENTS });
 
+	update_collision_filter(melee_entity);
+
 	return melee_entity;
 
 }
@@ -153,19 +161,23 @@ Entity createBoss(RenderSystem* renderer, vec2 pos, float health) {
 	Mesh& mesh = renderer->getMesh(GEOMETRY_BUFFER_ID::BACTERIOPHAGE);
 	registry.meshPtrs.emplace(entity, &mesh);
 
-	Motion& motion = registry.motions.emplace(entity);
-	motion.max_velocity = 250.f;
-	motion.max_angular_velocity = gameMode.id == GAME_MODE_ID::EASY_MODE ? M_PI / 6.f : M_PI / 4.f;
+	registry.motions.emplace(entity);
 	Dash& dash = registry.dashes.emplace(entity);
+	registry.sweptColliders.emplace(entity);
 	dash.active_duration_ms = 1000.f;
 	dash.delay_duration_ms = gameMode.id == GAME_MODE_ID::EASY_MODE ? 12000.f : 6000.f;
 	dash.max_dash_velocity = 400.f;
 
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = pos;
 	transform.scale = BACTERIOPHAGE_BOSS_SIZE;
 	transform.angle_offset = M_PI / 2;
 	transform.angle = transform.angle_offset;
+	// fetched after the transform insert, which moves the boss into the movables group
+	MotionRef motion = registry.motions.get(entity);
+	motion.max_velocity = 250.f;
+	motion.max_angular_velocity = gameMode.id == GAME_MODE_ID::EASY_MODE ? M_PI / 6.f : M_PI / 4.f;
+	registry.colliderShapes.insert(entity, { COLLIDER_PRIMITIVE::CAPSULE });
 
 	Health& enemyHealth = registry.healthValues.emplace(entity);
 	enemyHealth.health = fmin(health, gameMode.enemy_health_map[ENEMY_ID::BOSS]);
@@ -193,6 +205,7 @@ Entity createBoss(RenderSystem* renderer, vec2 pos, float health) {
 		  GEOMETRY_BUFFER_ID::SPRITE,
 		  RENDER_ORDER::BOSS });
 
+	update_collision_filter(entity);
 	createBossArms(renderer, entity, transform.scale);
 	std::cout << "Creating boss at position: " << pos.x << ", " << pos.y << std::endl;
 	return entity;
@@ -258,7 +271,7 @@ void createBossArms(RenderSystem* renderer, Entity bossEntity, vec2 bossSize) {
 
 			// The following transform will be adjusted in physics_system to follow its parent
 			registry.transforms.emplace(entity);
-			Motion& motion = registry.motions.emplace(entity);		// This motion is with respect to parent
+			MotionRef motion = registry.motions.emplace(entity);		// This motion is with respect to parent
 			motion.max_angular_velocity = M_PI / 4.f;
 			registry.enemies.insert(entity, { ENEMY_ID::BOSS_ARM });
 			registry.healthValues.insert(entity, { static_cast<float>(registry.gameMode.components.back().enemy_health_map[ENEMY_ID::BOSS_ARM]) });
@@ -271,6 +284,8 @@ void createBossArms(RenderSystem* renderer, Entity bossEntity, vec2 bossSize) {
 				  GEOMETRY_BUFFER_ID::SPRITE,
 				  RENDER_ORDER::ENEMIES_FR });
 
+			update_collision_filter(entity);
+
 			// Update parent to current part
 			parent_entity = entity;
 			parent_size = size;
@@ -283,6 +298,7 @@ Entity createSecondBoss(RenderSystem* renderer, vec2 pos, float health) {
 	auto boss_entity = Entity();
 	// Assuming boss is a type of enemy
 	Dash& enemy_dash = registry.dashes.emplace(boss_entity);
+	registry.sweptColliders.emplace(boss_entity);
 	enemy_dash.delay_duration_ms = PLAYER_DASH_DELAY / registry.gameMode.components.back().FRIEND_BOSS_DIFFICULTY * 2.f;
 	enemy_dash.active_duration_ms = 50.f;
 
@@ -291,13 +307,14 @@ Entity createSecondBoss(RenderSystem* renderer, vec2 pos, float health) {
 	new_enemy.type = ENEMY_ID::FRIENDBOSS;
 	registry.bosses.emplace(boss_entity);
 
-	Transform& transform = registry.transforms.emplace(boss_entity);
+	registry.motions.emplace(boss_entity);	// before the transform, see createPlayer
+	TransformRef transform = registry.transforms.emplace(boss_entity);
 	transform.position = pos;
 	transform.angle_offset = IMMUNITY_TEXTURE_ANGLE;
 	transform.angle = transform.angle_offset;
 	transform.scale = FRIEND_BOSS_SIZE;
 
-	Motion& motion = registry.motions.emplace(boss_entity);
+	MotionRef motion = registry.motions.get(boss_entity);
 
 	motion.max_velocity = 350.f;
 
@@ -324,6 +341,8 @@ Entity createSecondBoss(RenderSystem* renderer, vec2 pos, float health) {
 
 	std::cout << "Creating second boss at position: " << pos.x << ", " << pos.y << std::endl;
 
+	update_collision_filter(boss_entity);
+
 	return boss_entity;
 }
 
@@ -337,13 +356,14 @@ Entity createBossClone(vec2 pos, float health) {
 	// Setting initial components values
 	new_enemy.type = ENEMY_ID::FRIENDBOSSCLONE;
 
-	Transform& transform = registry.transforms.emplace(entity);
+	registry.motions.emplace(entity);	// before the transform, see createPlayer
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = pos;
 	transform.angle_offset = IMMUNITY_TEXTURE_ANGLE;
 	transform.angle = transform.angle_offset;
 	transform.scale = FRIEND_BOSS_SIZE;
 
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.get(entity);
 
 	motion.max_velocity = 300.f; // TODO: Dummy boss for now, change this later
 
@@ -358,6 +378,7 @@ Entity createBossClone(vec2 pos, float health) {
 		  EFFECT_ASSET_ID::TEXTURED,
 		  GEOMETRY_BUFFER_ID::SPRITE,
 		  RENDER_ORDER::BOSS });
+	update_collision_filter(entity);
 	return entity;
 }
 
@@ -370,13 +391,14 @@ Entity createRedEnemy(vec2 pos, float health) {
 	new_enemy.type = ENEMY_ID::RED;
 	registry.collidePlayers.emplace(entity);
 
-	Transform& transform = registry.transforms.emplace(entity);
+	registry.motions.emplace(entity);	// before the transform, see createPlayer
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = pos;
 	transform.angle_offset = M_PI / 2;
 	transform.angle = transform.angle_offset;
 	transform.scale = RED_ENEMY_SIZE;
 
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.get(entity);
 	motion.max_velocity = 400;
 	Health& enemyHealth = registry.healthValues.emplace(entity);
 	enemyHealth.health = registry.gameMode.components.back().enemy_health_map[ENEMY_ID::RED];
@@ -389,6 +411,8 @@ Entity createRedEnemy(vec2 pos, float health) {
 			GEOMETRY_BUFFER_ID::SPRITE,
 			RENDER_ORDER::ENEMIES_BK });
 
+	update_collision_filter(entity);
+
 	return entity;
 }
 
@@ -400,13 +424,14 @@ Entity createGreenEnemy(vec2 pos, float health) {
 	new_enemy.type = ENEMY_ID::GREEN;
 	registry.collidePlayers.emplace(entity);
 
-	Transform& transform = registry.transforms.emplace(entity);
+	registry.motions.emplace(entity);	// before the transform, see createPlayer
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = pos;
 	transform.scale = GREEN_ENEMY_SIZE;
 	transform.angle_offset = 3 * M_PI / 4;
 	transform.angle = transform.angle_offset;
 
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.get(entity);
 	motion.max_velocity = 200;
 	Health& enemyHealth = registry.healthValues.emplace(entity);
 	enemyHealth.health = registry.gameMode.components.back().enemy_health_map[ENEMY_ID::GREEN];;
@@ -423,6 +448,7 @@ Entity createGreenEnemy(vec2 pos, float health) {
 	animation.update_period_ms *= 2;
 	animation.total_frame = (int)ANIMATION_FRAME_COUNT::GREEN_ENEMY_MOVING;
 	animation.pause_animation = true;
+	update_collision_filter(entity);
 	return entity;
 }
 
@@ -440,11 +466,12 @@ Entity createYellowEnemy(vec2 pos, float health) {
 	weapon.bullet_size = { 25.f, 25.f };
 	weapon.bullet_color = { 0.718f, 1.f, 0.f, 1.f };
 
-	Transform& transform = registry.transforms.emplace(entity);
+	registry.motions.emplace(entity);	// before the transform, see createPlayer
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = pos;
 	transform.scale = YELLOW_ENEMY_SIZE;
 
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.get(entity);
 	motion.max_velocity = 0.0f;
 	motion.max_angular_velocity = M_PI;
 
@@ -458,6 +485,7 @@ Entity createYellowEnemy(vec2 pos, float health) {
 			EFFECT_ASSET_ID::TEXTURED,
 			GEOMETRY_BUFFER_ID::SPRITE,
 			RENDER_ORDER::ENEMIES_BK });
+	update_collision_filter(entity);
 	return entity;
 }
 
@@ -466,17 +494,13 @@ Entity createChest(vec2 pos, REGION_GOAL_ID ability) {
 	registry.collidePlayers.emplace(entity);
 
     // Set up the transform for the chest
-    Transform& transform = registry.transforms.emplace(entity);
+    TransformRef transform = registry.transforms.emplace(entity);
     transform.position = pos;
 	transform.scale = CHEST_SIZE;
+	registry.colliderShapes.insert(entity, { COLLIDER_PRIMITIVE::BOX });
 
-	// Motion component only needed for collision check, set all to 0
-	Motion& motion = registry.motions.emplace(entity);
-	motion.velocity = { 0.f, 0.f };
-	motion.max_velocity = 50.f;
-	motion.acceleration_unit = 0.f;
-	motion.deceleration_unit = 0.f;
-	motion.allow_accel = false;
+	// Never moves, collides through the static index instead of carrying a Motion
+	registry.staticColliders.emplace(entity);
 
     // Create the chest component
     Chest& chest = registry.chests.emplace(entity);
@@ -494,6 +518,8 @@ Entity createChest(vec2 pos, REGION_GOAL_ID ability) {
 
 	std::cout << "Creating chest (Entity ID: " << entity << ") at position: " << chest.position.x << ", " << chest.position.y << " with ability: " << static_cast<int>(chest.ability) << std::endl;
 
+	update_collision_filter(entity);
+
     return entity;
 }
 
@@ -501,17 +527,13 @@ Entity createCure(vec2 pos) {
 	auto entity = Entity();
 	registry.collidePlayers.emplace(entity);
 
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
     transform.position = pos;
 	transform.scale = CURE_SIZE;
+	registry.colliderShapes.insert(entity, { COLLIDER_PRIMITIVE::CAPSULE });
 
-	// Motion component only needed for collision check, set all to 0
-	Motion& motion = registry.motions.emplace(entity);
-	motion.velocity = { 0.f, 0.f };
-	motion.max_velocity = 50.f;
-	motion.acceleration_unit = 0.f;
-	motion.deceleration_unit = 0.f;
-	motion.allow_accel = false;
+	// Never moves, collides through the static index instead of carrying a Motion
+	registry.staticColliders.emplace(entity);
 
 	Cure& cure = registry.cure.emplace(entity);
 
@@ -525,6 +547,8 @@ Entity createCure(vec2 pos) {
 
 	std::cout << "Cure dropped at position: " << pos.x << ", " << pos.y << std::endl;
 
+	update_collision_filter(entity);
+
 	return entity;
 }
 
@@ -549,6 +573,7 @@ void createRandomRegions(size_t num_regions, std::default_random_engine& rng) {
 	//std::shuffle(unused_bosses.begin(), unused_bosses.end(), rng);
 
 	float angle = 0.f;
+	std::vector<float> start_angles;
 
 	for (int i = 0; i < num_regions; i++) {
 		auto entity = Entity();
@@ -600,8 +625,11 @@ void createRandomRegions(size_t num_regions, std::default_random_engine& rng) {
 		);
 
 		// Update angle
+		start_angles.push_back(angle);
 		angle += (M_PI * 2 / num_regions);
 	}
+
+	map_geometry.build(start_angles);
 }
 
 void createRandomCysts(std::default_random_engine& rng) {
@@ -656,15 +684,10 @@ void createCyst(vec2 pos, float health) {
 	registry.healthValues.insert(cyst_entity, {health});
 	registry.collidePlayers.emplace(cyst_entity);
 
-	// Motion component only needed for collision check, set all to 0
-	Motion& motion = registry.motions.emplace(cyst_entity);
-	motion.velocity = { 0.f, 0.f };
-	motion.max_velocity = 0.f;
-	motion.acceleration_unit = 0.f;
-	motion.deceleration_unit = 0.f;
-	motion.allow_accel = false;
+	// Never moves, collides through the static index instead of carrying a Motion
+	registry.staticColliders.emplace(cyst_entity);
 
-	Transform& transform = registry.transforms.emplace(cyst_entity);
+	TransformRef transform = registry.transforms.emplace(cyst_entity);
 	transform.position = pos;
 	transform.scale = CYST_TEXTURE_SIZE * 4.f;
 
@@ -679,6 +702,8 @@ void createCyst(vec2 pos, float health) {
 			EFFECT_ASSET_ID::TEXTURED,
 			GEOMETRY_BUFFER_ID::SPRITESHEET_CYST_SHINE,
 			RENDER_ORDER::ENEMIES_BK });
+
+	update_collision_filter(cyst_entity);
 }
 
 Entity createLine(vec2 position, float angle, vec2 scale) {
@@ -693,7 +718,7 @@ Entity createLine(vec2 position, float angle, vec2 scale) {
 
 	registry.colors.insert(entity, { 1.f,0.f,0.f,1.f });
 
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.angle = angle;
 	transform.position = position;
 	transform.scale = scale;
@@ -716,7 +741,7 @@ Entity createHoldGuide(vec2 position, vec2 scale) {
 
 	registry.colors.insert(entity, { 1.f,1.f,1.f,0.f });
 
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position = position;
 	transform.scale = scale;
 	transform.is_screen_coord = true;
@@ -822,12 +847,14 @@ void createBulletHelper(Entity shooter, vec2 scale, vec4 color, float angle_offs
 	// Create bullet's components
 	auto bullet_entity = Entity();
 
-	Transform& bullet_transform = registry.transforms.emplace(bullet_entity);
-	Motion& bullet_motion = registry.motions.emplace(bullet_entity);
+	// The motion insert moves the bullet into the movables group, so the transform is fetched after it
+	registry.transforms.emplace(bullet_entity);
+	MotionRef bullet_motion = registry.motions.emplace(bullet_entity);
+	TransformRef bullet_transform = registry.transforms.get(bullet_entity);
 	registry.colors.insert(bullet_entity, color);
 
 	// Set initial position and velocity
-	Transform& shooter_transform = registry.transforms.get(shooter);
+	TransformRef shooter_transform = registry.transforms.get(shooter);
 	Gun& weapon = registry.guns.get(shooter);
 
 	Transformation t;
@@ -867,6 +894,7 @@ void createBulletHelper(Entity shooter, vec2 scale, vec4 color, float angle_offs
 
 	// Set projectile damage based on weapon
 	registry.projectiles.insert(bullet_entity, { weapon.damage });
+	registry.sweptColliders.emplace(bullet_entity);
 
 	if (registry.collideEnemies.has(shooter)) {
 		registry.collideEnemies.emplace(bullet_entity);
@@ -882,6 +910,36 @@ void createBulletHelper(Entity shooter, vec2 scale, vec4 color, float angle_offs
 			EFFECT_ASSET_ID::COLOURED,
 			GEOMETRY_BUFFER_ID::BULLET,
 			RENDER_ORDER::OBJECTS });
+
+	update_collision_filter(bullet_entity);
+}
+
+void update_collision_filter(Entity entity) {
+	// Same precedence as the component checks this replaces, an entity has at most one of these
+	COLLISION_CATEGORY category = COLLISION_CATEGORY::NONE;
+	if (registry.projectiles.has(entity)) {
+		category = COLLISION_CATEGORY::PROJECTILE;
+	} else if (registry.players.has(entity)) {
+		category = COLLISION_CATEGORY::PLAYER;
+	} else if (registry.enemies.has(entity)) {
+		category = COLLISION_CATEGORY::ENEMY;
+	} else if (registry.attachments.has(entity) && registry.attachments.get(entity).type == ATTACHMENT_ID::SWORD) {
+		category = COLLISION_CATEGORY::SWORD;
+	} else if (registry.cysts.has(entity)) {
+		category = COLLISION_CATEGORY::CYST;
+	} else if (registry.chests.has(entity)) {
+		category = COLLISION_CATEGORY::CHEST;
+	} else if (registry.cure.has(entity)) {
+		category = COLLISION_CATEGORY::CURE;
+	}
+
+	uint8_t layers = 0;
+	if (registry.collidePlayers.has(entity)) layers |= COLLIDE_PLAYERS_LAYER;
+	if (registry.collideEnemies.has(entity)) layers |= COLLIDE_ENEMIES_LAYER;
+
+	CollisionFilter& filter = registry.collisionFilters.has(entity) ? registry.collisionFilters.get(entity) : registry.collisionFilters.emplace(entity);
+	filter.category = category;
+	filter.layers = layers;
 }
 
 Entity createCamera(vec2 pos) {
@@ -937,7 +995,7 @@ void createWaypoint(REGION_GOAL_ID goal, Entity target) {
 Entity createDeathScreen(int scenario) {
 	Entity entity = Entity();
 
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.scale = { DIALOG_TEXTURE_SIZE.x, DIALOG_TEXTURE_SIZE.y };
 	transform.is_screen_coord = true;
 
@@ -963,7 +1021,7 @@ Entity createCredits() {
 			EFFECT_ASSET_ID::COLOURED,
 			GEOMETRY_BUFFER_ID::STATUSBAR_RECTANGLE,
 			RENDER_ORDER::CREDITS_BG });
-	Transform& bg_transform = registry.transforms.emplace(black_screen);
+	TransformRef bg_transform = registry.transforms.emplace(black_screen);
 	bg_transform.is_screen_coord = true;
 	bg_transform.position.x -= CONTENT_WIDTH_PX / 2;
 	bg_transform.scale = { CONTENT_WIDTH_PX, CONTENT_HEIGHT_PX };
@@ -973,7 +1031,7 @@ Entity createCredits() {
 	Entity entity = Entity();
 
 	Credits& credits = registry.credits.emplace(entity);
-	Transform& transform = registry.transforms.emplace(entity);
+	TransformRef transform = registry.transforms.emplace(entity);
 	transform.position.y = -DIALOG_TEXTURE_SIZE.y;
 	transform.scale = { DIALOG_TEXTURE_SIZE.x, DIALOG_TEXTURE_SIZE.y };
 	transform.is_screen_coord = true;
@@ -988,7 +1046,7 @@ Entity createCredits() {
 	// Title texture
 	Entity title = Entity();
 
-	Transform& title_transform = registry.transforms.emplace(title);
+	TransformRef title_transform = registry.transforms.emplace(title);
 	title_transform.position.y = -DIALOG_TEXTURE_SIZE.y;
 	title_transform.scale = START_TITLE_TEXTURE_SIZE * 0.4f;
 	title_transform.is_screen_coord = true;
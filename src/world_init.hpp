@@ -82,3 +82,5 @@ Entity createHoldGuide(vec2 position, vec2 scale);
 
 /*************************[ other ]*************************/
 Entity createCamera(vec2 pos);
+// derive the collision filter from the components, call again after CollidePlayer or CollideEnemy changed
+void update_collision_filter(Entity entity);
@@ -228,8 +228,9 @@ void WorldSystem::on_controller_joy(int joy, int event) {
 
 }
 
-void WorldSystem::init(RenderSystem* renderer_arg) {
+void WorldSystem::init(RenderSystem* renderer_arg, PhysicsSystem* physics_arg) {
 	this->renderer = renderer_arg;
+	this->physics = physics_arg;
 	this->effects_system = new EffectsSystem(player, rng, soundChunks, *this);
 	this->menu_system = new MenuSystem(mouse);
 
@@ -240,6 +241,7 @@ void WorldSystem::init(RenderSystem* renderer_arg) {
 	hold_to_collect = createHoldGuide({ 0.f, CONTENT_HEIGHT_PX * -0.42 }, HOLD_GUIDE_TEXTURE_SIZE * 0.5f);
 	dialog_system = new DialogSystem(keys_pressed, mouse, controller_buttons);
 	registry.gameMode.insert(Entity(), regularMode);
+	apply_capacity_budgets(regularMode.id);
 
 	// Set all states to default
 	restart_game(true);
@@ -332,17 +334,14 @@ void WorldSystem::step_deathTimer(float elapsed_ms) {
 }
 
 void WorldSystem::remove_entity(Entity entity) {
-	// Remove all attachments of the entity recursively before removing itself
-	// Iterating backwards and updating i since multiple entities can be removed
-	for (int i = (int)registry.attachments.components.size() - 1;
-		i >= 0 && registry.attachments.components.size() > 0;
-		i = min(i - 1, (int)registry.attachments.components.size() - 1)
-		) {
+	// Destroy all attachments of the entity recursively along with itself.
+	// The removal is deferred, so the attachments container is not modified while scanning it
+	for (uint i = 0; i < registry.attachments.components.size(); i++) {
 		if (registry.attachments.components[i].parent == entity) {
 			remove_entity(registry.attachments.entities[i]);
 		}
 	}
-	registry.remove_all_components_of(entity);
+	registry.destroy_later(entity);
 }
 
 void WorldSystem::step_roll_credits(float elapsed_ms) {
@@ -402,6 +401,7 @@ void WorldSystem::startEntityDeath(Entity entity) {
 		death_screen = createDeathScreen(scenario);
 		registry.motions.get(player).max_velocity *= 0.f;
 		registry.collideEnemies.remove(player);
+		update_collision_filter(player);
 		registry.guns.get(player).attack_timer = 9999.f;
 		if (registry.melees.has(player)) {
 			registry.melees.get(player).attack_timer = 9999.f;
@@ -495,7 +495,7 @@ void WorldSystem::step_healthbar(float elapsed_ms, Entity healthbar, Entity targ
 
 		// Update the scale of the healthbar
 		assert(registry.transforms.has(healthbar));
-		Transform& transform = registry.transforms.get(healthbar);
+		TransformRef transform = registry.transforms.get(healthbar);
 		transform.scale.x = max_bar_len * STATUSBAR_SCALE.x * healthbar_scale;
 
 		// Update the color of the healthbar
@@ -574,7 +574,7 @@ void WorldSystem::step_attack(float elapsed_ms) {
 					Entity sword_entity = player_sword.melee_entity;
 					assert(registry.attachments.has(sword_entity) && registry.motions.has(sword_entity));
 					Attachment& att = registry.attachments.get(sword_entity);
-					Motion& sword_motion = registry.motions.get(sword_entity);
+					MotionRef sword_motion = registry.motions.get(sword_entity);
 					sword_motion.angular_velocity = 0;
 					att.moved_angle = att.angle_offset;
 				}
@@ -697,18 +697,14 @@ void WorldSystem::step_enemySpawn(float elapsed_ms) {
 
 // steps timers and invoke associated callback upon expiration
 void WorldSystem::step_timer_with_callback(float elapsed_ms) {
-	std::vector<Entity> garbage; // another garbage collector
 	for (uint i = 0; i < registry.timedEvents.components.size(); i++) {
 		TimedEvent& timedEvent = registry.timedEvents.components[i];
 		timedEvent.timer_ms -= elapsed_ms;
 		if (timedEvent.timer_ms <= 0.f) {
 			timedEvent.callback();
-			garbage.push_back(registry.timedEvents.entities[i]);
+			registry.destroy_later(registry.timedEvents.entities[i]);
 		}
 	}
-	for (Entity e : garbage) {
-		registry.remove_all_components_of(e);
-	}
 }
 
 void WorldSystem::step_waypoints() {
@@ -761,7 +757,7 @@ void WorldSystem::step_waypoints() {
 
 
 	float minDistance = MAP_RADIUS;
-	Entity closestWP;
+	Entity closestWP = Entity::null();
 	Game& game = registry.game.get(game_entity);
 	for (int i = (int)registry.waypoints.size() - 1; i >= 0; i--) {
 		Entity wp = registry.waypoints.entities[i];
@@ -769,7 +765,7 @@ void WorldSystem::step_waypoints() {
 
 		// Update waypoint targets to their live position
 		// waypoint.interest_point will be used in AI system
-		if (registry.transforms.has(waypoint.target)) {
+		if (registry.valid(waypoint.target) && registry.transforms.has(waypoint.target)) {
 			waypoint.interest_point = registry.transforms.get(waypoint.target).position;
 		}
 		else {
@@ -841,7 +837,7 @@ void WorldSystem::remove_garbage() {
 	for (Entity bullet : registry.projectiles.entities) {
 		Transform transform = registry.transforms.get(bullet);
 		if (length(transform.position - player_pos) > SCREEN_RADIUS + 200.f) {
-			registry.remove_all_components_of(bullet);
+			registry.destroy_later(bullet);
 		}
 	}
 
@@ -852,7 +848,7 @@ void WorldSystem::remove_garbage() {
 			Transform enemyTransform = registry.transforms.get(enemyEntity);
 			//consider player_pos as the center pointer of the player's view screen. despawn enemy if it is out of the view
 			if (length(enemyTransform.position - player_pos) > SCREEN_RADIUS + 200.f) {
-				registry.remove_all_components_of(enemyEntity);
+				registry.destroy_later(enemyEntity);
 				enemyCounts[enemyComponent.type]--;
 				printf("remove enemy with id = %d at position <%f, %f>\n", static_cast<int>(enemyEntity), enemyTransform.position.x, enemyTransform.position.y);
 			}
@@ -1061,6 +1057,8 @@ void WorldSystem::restart_game(bool hard_reset) {
 	printf("\n=========================\n|\tRestarting\t|\n=========================\n");
 
 	reset_game_state(hard_reset);
+	// The first frame of the new world does not blend in the old one
+	renderer->reset_interpolation();
 
 	/*************************[ setup new world ]*************************/
 
@@ -1149,15 +1147,21 @@ void WorldSystem::show_hold_to_collect() {
 // Compute collisions between entities
 void WorldSystem::resolve_collisions() {
 	// Loop over all collisions detected by the physics system
-	std::list<Entity> garbage{};
+	// Entities used up by a collision are destroyed at the end of the frame (see ECSRegistry::flush_pending)
 	auto& collisionsRegistry = registry.collisions;
-	bool show_hold_guide = false;
 	for (uint i = 0; i < collisionsRegistry.components.size(); i++) {
 		// The entity and its collider
 		Entity entity = collisionsRegistry.entities[i];
 		Collision collision = collisionsRegistry.components[i];
-		Transform& transform = registry.transforms.get(entity);
-		Motion& motion = registry.motions.get(entity);
+		// Only the chests react to contacts ending
+		if (collision.state == CONTACT_STATE::END) {
+			if (collision.collision_type == COLLISION_TYPE::PLAYER_WITH_CHEST && registry.chests.has(collision.other_entity)) {
+				registry.chests.get(collision.other_entity).isTouched = false;
+			}
+			continue;
+		}
+		TransformRef transform = registry.transforms.get(entity);
+		MotionRef motion = registry.motions.get(entity);
 		// When any moving object collides with the boundary, it gets bounced towards the 
 		// reflected direction (similar to the physics model of reflection of light)
 		if (collision.collision_type == COLLISION_TYPE::WITH_BOUNDARY) {
@@ -1184,8 +1188,8 @@ void WorldSystem::resolve_collisions() {
 			// When player collides with enemy, only player gets knocked back,
 			// towards its relative direction from the enemy
 			Entity enemy_entity = collision.other_entity;
-			Transform& enemy_transform = registry.transforms.get(enemy_entity);
-			Motion& enemy_motion = registry.motions.get(enemy_entity);
+			TransformRef enemy_transform = registry.transforms.get(enemy_entity);
+			MotionRef enemy_motion = registry.motions.get(enemy_entity);
 			vec2 knockback_direction = normalize(transform.position - enemy_transform.position);
 			motion.velocity = (enemy_motion.max_velocity + 1000) * knockback_direction;
 			allow_accel = false;
@@ -1201,95 +1205,8 @@ void WorldSystem::resolve_collisions() {
 			squish(player, 0.96f);
 		}
 		else if (collision.collision_type == COLLISION_TYPE::PLAYER_WITH_CHEST) {
-			updateSpaceBarPressDuration();
-			Entity chestEntity = collision.other_entity;
-			Chest& chest = registry.chests.get(chestEntity);
-
-			if (!chest.isOpened && isHoldingSpace(100.0f)) {
-				enemy_spawn_cooldown = 1000.f; // lower cooldown set by step_chests()
-
-				chest.isOpened = true;
-				Entity abilityEntity = Entity();
-
-				// Grant the ability to the player
-				switch (chest.ability) {
-				case REGION_GOAL_ID::SWORD_ATTACK: {
-					registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::SWORD });
-					createSword(renderer, player);
-					dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_SWORD, 1500.f);
-					if (controller_mode) {
-						dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_SWORD_CONTROLLER, 1000.f);
-					}
-					else {
-						dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_SWORD_MOUSE, 1000.f);
-					}
-					Mix_PlayChannel(chunkToChannel["sword_unlock"], soundChunks["sword_unlock"], 0);
-					std::cout << "Player received SWORD ability from chest." << std::endl;
-					break;
-				}
-				case REGION_GOAL_ID::MULTIPLE_BULLETS: {
-					registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::BULLET_BOOST });
-					assert(registry.guns.has(player));
-					Gun& gun_component = registry.guns.get(player);
-					gun_component.attack_delay /= 2;
-					Entity gun_entity = getAttachment(player, ATTACHMENT_ID::GUN);
-					assert(registry.colors.has(gun_entity));
-					vec4& gun_color = registry.colors.get(gun_entity);
-					gun_color.g = 0.5f;
-					gun_color.b = 0.5f;
-					assert(registry.attachments.has(gun_entity));
-					Attachment& att = registry.attachments.get(gun_entity);	// This is a quick workaround
-					att.relative_transform_2.scale({ 1.5f, 1.5f });
-					dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_BULLETBOOST, 1500.f);
-					Mix_PlayChannel(chunkToChannel["bullet_unlock"], soundChunks["bullet_unlock"], 0);
-					std::cout << "Player received BULLET_BOOST ability from chest." << std::endl;
-					break;
-				}
-				case REGION_GOAL_ID::HEALTH_BOOST: {
-					registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::HEALTH_BOOST });
-					Health& health = registry.healthValues.get(player);
-					assert(registry.renderRequests.has(healthbar_frame));
-					registry.renderRequests.get(healthbar_frame).used_texture = TEXTURE_ASSET_ID::HEALTHBAR_FRAME_BOOST;
-					assert(registry.healthbar.has(healthbar));
-					registry.healthbar.get(healthbar).full_health_color = { 0.f, 1.f, 1.f, 1.f };
-					dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_HEALTHBOOST, 1500.f);
-					health.healthMultiplier = 2.0f; // Double the health multiplier
-					health.maxHealth *= health.healthMultiplier; // Update maximum health
-					health.health = health.maxHealth; // Set current health to max
-					health.healthIncrement = 1.0f; // Set health increment, e.g., 1 health point per second
-					Mix_PlayChannel(chunkToChannel["health_unlock"], soundChunks["health_unlock"], 0);
-					std::cout << "Player received HEALTH_BOOST ability from chest." << std::endl;
-					break;
-				}
-				case REGION_GOAL_ID::DASH: {
-					registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::DASHING });
-					createDashing(player);
-					dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_DASHING, 1500.f);
-					if (controller_mode) {
-						dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_DASHING_CONTROLLER, 1000.f);
-					}
-					else {
-						dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_DASHING_KEYBOARD, 1000.f);
-					}
-					Mix_PlayChannel(chunkToChannel["dash_unlock"], soundChunks["dash_unlock"], 0);
-					std::cout << "Player received DASHING ability from chest." << std::endl;
-					break;
-				}
-				default:
-					std::cout << "Unknown ability. Error." << std::endl;
-				}
-
-				for (auto& region : registry.regions.components) {
-					if (region.goal == chest.ability) {
-						region.is_cleared = true;
-					}
-				}
-
-				garbage.push_back(chestEntity);
-			}
-			else if (!chest.isOpened) {
-				show_hold_guide = true;
-			}
+			// Collected by holding space while touching it, see step_chests()
+			registry.chests.get(collision.other_entity).isTouched = true;
 		}
 		else if (collision.collision_type == COLLISION_TYPE::PLAYER_WITH_CURE) {
 			Entity cureEntity = collision.other_entity;
@@ -1305,7 +1222,7 @@ void WorldSystem::resolve_collisions() {
 				}
 			}
 
-			garbage.push_back(cureEntity);
+			registry.destroy_later(cureEntity);
 		}
 		else if (collision.collision_type == COLLISION_TYPE::BULLET_WITH_ENEMY) {
 			// When bullet collides with enemy, only enemy gets knocked back,
@@ -1313,8 +1230,8 @@ void WorldSystem::resolve_collisions() {
 			Entity enemy_entity = collision.other_entity;
 			Enemy& enemyAttrib = registry.enemies.get(enemy_entity);
 			if (enemyAttrib.type != ENEMY_ID::BOSS) {
-				Transform& enemy_transform = registry.transforms.get(enemy_entity);
-				Motion& enemy_motion = registry.motions.get(enemy_entity);
+				TransformRef enemy_transform = registry.transforms.get(enemy_entity);
+				MotionRef enemy_motion = registry.motions.get(enemy_entity);
 				vec2 knockback_direction = normalize(enemy_transform.position - transform.position);
 				enemy_motion.velocity = enemy_motion.max_velocity * knockback_direction;
 				enemy_motion.allow_accel = false;
@@ -1327,7 +1244,7 @@ void WorldSystem::resolve_collisions() {
 
 			Mix_PlayChannel(chunkToChannel["enemy_hit"], soundChunks["enemy_hit"], 0);
 
-			garbage.push_back(entity);
+			registry.destroy_later(entity);
 
 		}
 		else if (collision.collision_type == COLLISION_TYPE::BULLET_WITH_CYST) {
@@ -1339,7 +1256,7 @@ void WorldSystem::resolve_collisions() {
 
 			Mix_PlayChannel(chunkToChannel["enemy_hit"], soundChunks["enemy_hit"], 0);
 			squish(cyst, 0.9f);
-			garbage.push_back(entity);
+			registry.destroy_later(entity);
 		}
 		else if (collision.collision_type == COLLISION_TYPE::SWORD_WITH_ENEMY) {
 			assert(registry.attachments.has(entity));
@@ -1348,8 +1265,8 @@ void WorldSystem::resolve_collisions() {
 			Entity enemy_entity = collision.other_entity;
 			Enemy& enemyAttrib = registry.enemies.get(enemy_entity);
 			if (enemyAttrib.sword_attack_cd <= 0.f) {
-				Transform& enemy_transform = registry.transforms.get(enemy_entity);
-				Motion& enemy_motion = registry.motions.get(enemy_entity);
+				TransformRef enemy_transform = registry.transforms.get(enemy_entity);
+				MotionRef enemy_motion = registry.motions.get(enemy_entity);
 				vec2 knockback_direction = normalize(enemy_transform.position - transform.position);
 				// No knockback on boss
 				if (enemyAttrib.type != ENEMY_ID::BOSS) {
@@ -1409,7 +1326,7 @@ void WorldSystem::resolve_collisions() {
 		else if (collision.collision_type == COLLISION_TYPE::PLAYER_WITH_CYST
 			&& !registry.invincibility.has(entity)) {
 			Entity cyst = collision.other_entity;
-			Transform& cyst_transform = registry.transforms.get(cyst);
+			TransformRef cyst_transform = registry.transforms.get(cyst);
 			vec2 knockback_direction = normalize(transform.position - cyst_transform.position);
 			motion.velocity = 150.f * knockback_direction;
 			allow_accel = false;
@@ -1421,8 +1338,8 @@ void WorldSystem::resolve_collisions() {
 
 			registry.invincibility.emplace(player);
 
-			Transform& player_transform = registry.transforms.get(player);
-			Motion& player_motion = registry.motions.get(player);
+			TransformRef player_transform = registry.transforms.get(player);
+			MotionRef player_motion = registry.motions.get(player);
 			vec2 knockback_direction = normalize(player_transform.position - transform.position);
 
 			player_motion.velocity = (motion.max_velocity + 1000) * knockback_direction;
@@ -1435,22 +1352,12 @@ void WorldSystem::resolve_collisions() {
 			Mix_PlayChannel(chunkToChannel["player_hit"], soundChunks["player_hit"], 0);
 			squish(player, 0.96f);
 
-			garbage.push_back(entity);
+			registry.destroy_later(entity);
 		}
 		else if (collision.collision_type == COLLISION_TYPE::BULLET_WITH_BOUNDARY) {
-			garbage.push_back(entity);
+			registry.destroy_later(entity);
 		}
 	}
-	if (show_hold_guide) {
-		show_hold_to_collect();
-	}
-	else {
-		registry.colors.get(hold_to_collect).a = 0.f;
-	}
-	for (Entity i : garbage) {
-		registry.remove_all_components_of(i);
-	}
-
 	// Remove all collisions from this simulation step
 	registry.collisions.clear();
 }
@@ -1793,7 +1700,7 @@ void WorldSystem::step_controller() {
 }
 
 void WorldSystem::control_movement(float elapsed_ms) {
-	Motion& playermovement = registry.motions.get(player);
+	MotionRef playermovement = registry.motions.get(player);
 
 	// Vertical movement
 	if (keys_pressed[GLFW_KEY_W]) {
@@ -1833,9 +1740,13 @@ void WorldSystem::control_movement(float elapsed_ms) {
 
 template <typename Component>
 void WorldSystem::clearSpecificEntities(ComponentContainer<Component>& componentRegistry) {
-	while (!componentRegistry.entities.empty()) {
-		registry.remove_all_components_of(componentRegistry.entities.back());
+	// Copied, the removals shrink the container
+	std::vector<Entity> entities = componentRegistry.entities;
+	for (Entity entity : entities) {
+		registry.remove_all_components_of(entity);
 	}
+	// Components of released handles are not reached through their signature
+	componentRegistry.clear();
 }
 
 void WorldSystem::reset_game_state(bool hard_reset) {
@@ -1853,8 +1764,12 @@ void WorldSystem::reset_game_state(bool hard_reset) {
 	// Remove entities that will be recreated
 	clearSpecificEntities(registry.timedEvents);
 	clearSpecificEntities(registry.motions);
+	clearSpecificEntities(registry.staticColliders);
+	clearSpecificEntities(registry.colliderShapes);
+	clearSpecificEntities(registry.collisionFilters);
 	clearSpecificEntities(registry.players);
 	clearSpecificEntities(registry.collisions);
+	physics->clear_contacts();
 	clearSpecificEntities(registry.cysts);
 	clearSpecificEntities(registry.waypoints);
 	clearSpecificEntities(registry.chests);
@@ -1885,6 +1800,7 @@ void WorldSystem::reset_game_state(bool hard_reset) {
 		registry.remove_all_components_of(death_screen);
 
 		createRandomRegions(NUM_REGIONS, rng);
+		game_entity = Entity(); // the old id was released with its components
 		registry.game.emplace(game_entity);
 
 		// Recreate Healthbars
@@ -2175,8 +2091,8 @@ bool WorldSystem::hasPlayerAbility(PLAYER_ABILITY_ID abilityId) {
 	return false;
 }
 
-Entity& WorldSystem::getAttachment(Entity character, ATTACHMENT_ID type) {
-	Entity attachment_entity;
+Entity WorldSystem::getAttachment(Entity character, ATTACHMENT_ID type) {
+	Entity attachment_entity = Entity::null();
 	for (uint i = 0; i < registry.attachments.size(); i++) {
 		Attachment& att = registry.attachments.components[i];
 		if (att.parent == character && att.type == type)
@@ -2216,8 +2132,8 @@ void WorldSystem::control_direction() {
 
 	// Set player angle
 	assert(registry.transforms.has(player));
-	Transform& playertransform = registry.transforms.get(player);
-	Transform& cursortransform = registry.transforms.get(cursor);
+	TransformRef playertransform = registry.transforms.get(player);
+	TransformRef cursortransform = registry.transforms.get(cursor);
 
 	int present = glfwJoystickPresent(GLFW_JOYSTICK_1);
 	if (present && controller_mode) {
@@ -2282,7 +2198,7 @@ void WorldSystem::player_sword_slash() {
 			Entity sword_entity = player_sword.melee_entity;
 			assert(registry.attachments.has(sword_entity) && registry.motions.has(sword_entity));
 			Attachment& att = registry.attachments.get(sword_entity);
-			Motion& sword_motion = registry.motions.get(sword_entity);
+			MotionRef sword_motion = registry.motions.get(sword_entity);
 			sword_motion.angular_velocity = sword_motion.max_angular_velocity;
 			Mix_PlayChannel(chunkToChannel["sword_unlock"], soundChunks["sword_unlock"], 0);
 
@@ -2299,7 +2215,7 @@ void WorldSystem::player_dash() {
 		return;
 	}
 
-	Motion& playerMovement = registry.motions.get(player);
+	MotionRef playerMovement = registry.motions.get(player);
 	vec2 dashDirection;
 
 	if (keys_pressed[GLFW_KEY_W] || keys_pressed[GLFW_KEY_A] || keys_pressed[GLFW_KEY_S] || keys_pressed[GLFW_KEY_D]) {
@@ -2375,6 +2291,7 @@ void WorldSystem::setGameMode(GAME_MODE_ID id) {
 		gm = regularMode;
 	}
 	registry.gameMode.components.back() = gm;
+	apply_capacity_budgets(id);
 	maxEnemies[ENEMY_ID::RED] = gm.max_red;
 	maxEnemies[ENEMY_ID::GREEN] = gm.max_green;
 	maxEnemies[ENEMY_ID::YELLOW] = gm.max_yellow;
@@ -2385,6 +2302,27 @@ void WorldSystem::setGameMode(GAME_MODE_ID id) {
 	}
 }
 
+// Reserve the containers for the peak counts of the game mode, so steady-state frames do not allocate
+void WorldSystem::apply_capacity_budgets(GAME_MODE_ID id) {
+	const CapacityBudget& budget = capacity_budgets[id];
+	registry.enemies.set_budget(budget.enemies);
+	registry.healthValues.set_budget(budget.enemies + 1);	// and the player
+	registry.deathTimers.set_budget(budget.enemies + 1);
+	registry.guns.set_budget(budget.enemies + 1);
+	registry.projectiles.set_budget(budget.projectiles);
+	registry.colors.set_budget(budget.projectiles);
+	registry.transforms.set_budget(budget.movables);
+	registry.motions.set_budget(budget.movables);
+	registry.meshPtrs.set_budget(budget.movables);
+	registry.collidePlayers.set_budget(budget.movables);
+	registry.collideEnemies.set_budget(budget.movables);
+	registry.staticColliders.set_budget(STATIC_ENTITY_BUDGET);
+	registry.renderRequests.set_budget(budget.render_requests);
+	registry.collisions.set_budget(budget.collisions);
+	// indices are recycled only past MIN_FREE_INDICES free ones, so they climb that far above the live entities
+	registry.reserve_entities(budget.movables + Entity::MIN_FREE_INDICES);
+}
+
 void WorldSystem::step_menu() {
 	if (state == GAME_STATE::START_MENU) {
 		MENU_OPTION option = menu_system->poll_start_menu();
@@ -2435,8 +2373,8 @@ void WorldSystem::detect_bossfight() {
 		// Assume only 1 boss exists at any time
 		Entity current_boss = registry.bosses.entities[0];
 		if (!registry.bosses.get(current_boss).activated) {
-			Transform& boss_transform = registry.transforms.get(current_boss);
-			Transform& player_transform = registry.transforms.get(player);
+			TransformRef boss_transform = registry.transforms.get(current_boss);
+			TransformRef player_transform = registry.transforms.get(player);
 			vec2 player_pos = player_transform.position;
 			vec2 boss_pos = boss_transform.position;
 			vec2 distance = abs(player_pos - boss_pos);	// As soon as half of the boss is visible
@@ -2444,6 +2382,7 @@ void WorldSystem::detect_bossfight() {
 			if (distance.x < CONTENT_WIDTH_PX / 2.f && distance.y < CONTENT_HEIGHT_PX / 2.f) {
 				registry.bosses.get(current_boss).activated = true;
 				registry.collidePlayers.emplace(current_boss);	// set here to avoid hitting boss when inactive
+				update_collision_filter(current_boss);
 				// start boss music
 				Mix_FadeInMusic(backgroundMusic["boss"], -1, 5000);
 
@@ -2480,6 +2419,7 @@ void WorldSystem::detect_bossfight() {
 						Attachment& att = registry.attachments.components[i];
 						if (att.type == ATTACHMENT_ID::BACTERIOPHAGE_ARM) {
 							registry.collidePlayers.emplace(registry.attachments.entities[i]);
+							update_collision_filter(registry.attachments.entities[i]);
 						}
 					}
 
@@ -2527,7 +2467,8 @@ void WorldSystem::step_chests() {
 					printf("set cooldown\n");
 
 					// second timer: don't activate again for x seconds
-					TimedEvent& timer = registry.timedEvents.emplace(Entity());
+					// deferred, since this runs while the timed events are being iterated
+					TimedEvent timer;
 					timer.timer_ms = 25000.f;
 					timer.callback = [c, this]() {
 						// second callback: this code will run when second timer expires
@@ -2538,8 +2479,114 @@ void WorldSystem::step_chests() {
 							chest.waveActivated = false;
 						}
 						};
+					registry.insert_later(Entity(), std::move(timer));
 					};
 			}
 		}
 	}
+	// Hold to collect: space held while the player touches a chest opens it
+	bool show_hold_guide = false;
+	for (uint i = 0; i < registry.chests.size(); i++) {
+		Entity c = registry.chests.entities[i];
+		Chest& chest = registry.chests.components[i];
+		if (!chest.isTouched || chest.isOpened) continue;
+		updateSpaceBarPressDuration();
+		if (isHoldingSpace(100.0f)) {
+			open_chest(c);
+		}
+		else {
+			show_hold_guide = true;
+		}
+	}
+	if (show_hold_guide) {
+		show_hold_to_collect();
+	}
+	else {
+		registry.colors.get(hold_to_collect).a = 0.f;
+	}
+}
+
+// Grants the chest's ability to the player and clears its region
+void WorldSystem::open_chest(Entity chestEntity) {
+	enemy_spawn_cooldown = 1000.f; // lower cooldown set by step_chests()
+
+	Chest& chest = registry.chests.get(chestEntity);
+	chest.isOpened = true;
+	Entity abilityEntity = Entity();
+
+	// Grant the ability to the player
+	switch (chest.ability) {
+	case REGION_GOAL_ID::SWORD_ATTACK: {
+		registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::SWORD });
+		createSword(renderer, player);
+		dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_SWORD, 1500.f);
+		if (controller_mode) {
+			dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_SWORD_CONTROLLER, 1000.f);
+		}
+		else {
+			dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_SWORD_MOUSE, 1000.f);
+		}
+		Mix_PlayChannel(chunkToChannel["sword_unlock"], soundChunks["sword_unlock"], 0);
+		std::cout << "Player received SWORD ability from chest." << std::endl;
+		break;
+	}
+	case REGION_GOAL_ID::MULTIPLE_BULLETS: {
+		registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::BULLET_BOOST });
+		assert(registry.guns.has(player));
+		Gun& gun_component = registry.guns.get(player);
+		gun_component.attack_delay /= 2;
+		Entity gun_entity = getAttachment(player, ATTACHMENT_ID::GUN);
+		assert(registry.colors.has(gun_entity));
+		vec4& gun_color = registry.colors.get(gun_entity);
+		gun_color.g = 0.5f;
+		gun_color.b = 0.5f;
+		assert(registry.attachments.has(gun_entity));
+		Attachment& att = registry.attachments.get(gun_entity);	// This is a quick workaround
+		att.relative_transform_2.scale({ 1.5f, 1.5f });
+		dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_BULLETBOOST, 1500.f);
+		Mix_PlayChannel(chunkToChannel["bullet_unlock"], soundChunks["bullet_unlock"], 0);
+		std::cout << "Player received BULLET_BOOST ability from chest." << std::endl;
+		break;
+	}
+	case REGION_GOAL_ID::HEALTH_BOOST: {
+		registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::HEALTH_BOOST });
+		Health& health = registry.healthValues.get(player);
+		assert(registry.renderRequests.has(healthbar_frame));
+		registry.renderRequests.get(healthbar_frame).used_texture = TEXTURE_ASSET_ID::HEALTHBAR_FRAME_BOOST;
+		assert(registry.healthbar.has(healthbar));
+		registry.healthbar.get(healthbar).full_health_color = { 0.f, 1.f, 1.f, 1.f };
+		dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_HEALTHBOOST, 1500.f);
+		health.healthMultiplier = 2.0f; // Double the health multiplier
+		health.maxHealth *= health.healthMultiplier; // Update maximum health
+		health.health = health.maxHealth; // Set current health to max
+		health.healthIncrement = 1.0f; // Set health increment, e.g., 1 health point per second
+		Mix_PlayChannel(chunkToChannel["health_unlock"], soundChunks["health_unlock"], 0);
+		std::cout << "Player received HEALTH_BOOST ability from chest." << std::endl;
+		break;
+	}
+	case REGION_GOAL_ID::DASH: {
+		registry.playerAbilities.insert(abilityEntity, { PLAYER_ABILITY_ID::DASHING });
+		createDashing(player);
+		dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_DASHING, 1500.f);
+		if (controller_mode) {
+			dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_DASHING_CONTROLLER, 1000.f);
+		}
+		else {
+			dialog_system->add_dialog(TEXTURE_ASSET_ID::TUTORIAL_UNLOCK_DASHING_KEYBOARD, 1000.f);
+		}
+		Mix_PlayChannel(chunkToChannel["dash_unlock"], soundChunks["dash_unlock"], 0);
+		std::cout << "Player received DASHING ability from chest." << std::endl;
+		break;
+	}
+	default:
+		std::cout << "Unknown ability. Error." << std::endl;
+	}
+
+	for (auto& region : registry.regions.components) {
+		if (region.goal == chest.ability) {
+			region.is_cleared = true;
+		}
+	}
+
+	registry.destroy_later(chestEntity);
 }
@@ -15,6 +15,8 @@
 #include <SDL.h>
 #include <SDL_mixer.h>
 
+class PhysicsSystem;
+
 // Container for all our entities and game logic. Individual rendering / update is
 // deferred to the relative update() methods
 class WorldSystem
@@ -28,7 +30,7 @@ public:
 	void on_controller_joy(int joy, int event);
 
 	// starts the game
-	void init(RenderSystem* renderer);
+	void init(RenderSystem* renderer, PhysicsSystem* physics);
 
 	// Releases all associated resources
 	~WorldSystem();
@@ -80,6 +82,7 @@ private:
 
 	// Game state
 	RenderSystem* renderer;
+	PhysicsSystem* physics = nullptr;
 	EffectsSystem* effects_system;
 	float current_speed;
 	Entity player;
@@ -142,6 +145,7 @@ private:
 	void step_healthBoost(float elapsed_ms);
 	void step_roll_credits(float elapsed_ms);
 	void step_chests();
+	void open_chest(Entity chestEntity);
 
 	void spawnEnemiesNearInterestPoint(vec2 player_position);
 	void spawnEnemyOfType(ENEMY_ID type, vec2 player_position, vec2 player_velocity);
@@ -156,9 +160,10 @@ private:
 	void save_game();
 	json serializeGameState();
 
-	Entity& getAttachment(Entity character, ATTACHMENT_ID type);
+	Entity getAttachment(Entity character, ATTACHMENT_ID type);
 	bool hasPlayerAbility(PLAYER_ABILITY_ID abilityId);
 	void show_hold_to_collect();
 
 	void setGameMode(GAME_MODE_ID id);
+	void apply_capacity_budgets(GAME_MODE_ID id);
 };